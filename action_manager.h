@@ -1,4 +1,5 @@
 #include "strategy.h"
+#include "logger.h"
 // #include "viewer.h"
 #pragma once
 
@@ -6,18 +7,38 @@ class ActionManager {
 private:
     std::shared_ptr<GlobalStrategy> globalStrategyPtr;
     std::shared_ptr<MovementStrategy> movementStrategyPtr;
+    Point lastTarget_;
+    bool hasLastTarget_;
 
 public:
-    ActionManager() { }
+    ActionManager() : hasLastTarget_(false) { }
 
     ActionManager(std::shared_ptr<GlobalStrategy> globalStrategy,
                   std::shared_ptr<MovementStrategy> movementStrategy)
-            : globalStrategyPtr(globalStrategy), movementStrategyPtr(movementStrategy) { }
+            : globalStrategyPtr(globalStrategy), movementStrategyPtr(movementStrategy), hasLastTarget_(false) { }
 
     Acceleration performGamerAction(const World &world, const Ball &ball) {
-        std::cout << "Gamer performs action" << std::endl;
-        return movementStrategyPtr->
-                getAcceleration(world, globalStrategyPtr->getTask(world, ball), ball);
+        LOG_DEBUG("Gamer performs action");
+        StrategyTaskPtr task = globalStrategyPtr->getTask(world, ball);
+        lastTarget_ = task->getTargetPoint(world, ball);
+        hasLastTarget_ = true;
+        return movementStrategyPtr->getAcceleration(world, task, ball);
+    }
+
+    void setTurnDeadline(GlobalStrategy::Clock::time_point deadline) {
+        globalStrategyPtr->setTurnDeadline(deadline);
+    }
+
+    // Spends spare time on the global strategy's plan, see GlobalStrategy::improveTasks
+    template<typename Stop>
+    bool improvePlan(Stop stop) {
+        return globalStrategyPtr->improveTasks(stop);
+    }
+
+    // Target of the last performed action, used to steer while a new plan is not ready
+    bool getLastTarget(Point &target) const {
+        target = lastTarget_;
+        return hasLastTarget_;
     }
 /*
     void performViewerAction(const World &world, Notifier* notifier, bool& show_first_time) {
@@ -0,0 +1,209 @@
+#ifndef BINARY_MESSAGE_BUILDER_H
+#define BINARY_MESSAGE_BUILDER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "protocol.h"
+#include "world_tracker.h"
+
+// Encoders for the binary STATE and TURN layout described in protocol.h. Fields are written
+// little-endian whatever the host order; the output buffers are caller-owned and reused.
+
+void PutBinaryUint16(char *out, uint16_t value) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap16(value);
+#endif
+    std::memcpy(out, &value, sizeof(value));
+}
+
+void PutBinaryUint32(char *out, uint32_t value) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    std::memcpy(out, &value, sizeof(value));
+}
+
+void PutBinaryUint64(char *out, uint64_t value) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    std::memcpy(out, &value, sizeof(value));
+}
+
+void PutBinaryDouble(char *out, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    PutBinaryUint64(out, bits);
+}
+
+void PutBinaryHeader(char *out, BinaryMessageKind kind, uint32_t flags) {
+    out[0] = static_cast<char>(BINARY_MARKER);
+    out[1] = static_cast<char>(kind);
+    PutBinaryUint16(out + 2, BINARY_VERSION);
+    PutBinaryUint32(out + 4, flags);
+}
+
+// Header, ids and radii of a STATE or KEYFRAME; returns the position after them
+char *PutBinaryStateHeader(char *out, BinaryMessageKind kind, const World &world) {
+    PutBinaryHeader(out, kind, 0);
+    out += BINARY_HEADER_SIZE;
+    PutBinaryUint64(out, world.world_id);
+    PutBinaryDouble(out + 8, world.field_radius);
+    PutBinaryDouble(out + 16, world.ball_radius);
+    PutBinaryDouble(out + 24, world.coin_radius);
+    PutBinaryDouble(out + 32, world.delta_time);
+    PutBinaryDouble(out + 40, world.max_velocity);
+    PutBinaryUint32(out + 48, world.balls.size());
+    PutBinaryUint32(out + 52, world.coins.size());
+    return out + BINARY_STATE_HEADER_SIZE - BINARY_HEADER_SIZE;
+}
+
+char *PutBinaryBall(char *out, const Ball &ball) {
+    PutBinaryUint32(out, ball.id_);
+    PutBinaryDouble(out + 4, ball.position_.x_);
+    PutBinaryDouble(out + 12, ball.position_.y_);
+    PutBinaryDouble(out + 20, ball.velocity_.v_x_);
+    PutBinaryDouble(out + 28, ball.velocity_.v_y_);
+    PutBinaryDouble(out + 36, ball.score_);
+    return out + BINARY_BALL_SIZE;
+}
+
+char *PutBinaryCoin(char *out, const Coin &coin) {
+    PutBinaryDouble(out, coin.position_.x_);
+    PutBinaryDouble(out + 8, coin.position_.y_);
+    PutBinaryDouble(out + 16, coin.value_);
+    return out + BINARY_COIN_SIZE;
+}
+
+// Replaces the contents of buffer with the STATE frame body for world
+void BuildBinaryWorldStateMessage(const World &world, std::string &buffer) {
+    buffer.resize(BINARY_STATE_HEADER_SIZE + world.balls.size() * BINARY_BALL_SIZE +
+                  world.coins.size() * BINARY_COIN_SIZE);
+    char *out = PutBinaryStateHeader(&buffer[0], BINARY_STATE, world);
+    for (const Ball &ball : world.balls) {
+        out = PutBinaryBall(out, ball);
+    }
+    for (const Coin &coin : world.coins) {
+        out = PutBinaryCoin(out, coin);
+    }
+}
+
+std::string BuildBinaryWorldStateMessage(const WorldStateMessage &message) {
+    std::string buffer;
+    BuildBinaryWorldStateMessage(message.world, buffer);
+    return buffer;
+}
+
+void BuildBinaryTurnMessage(const TurnMessage &message, std::string &buffer) {
+    buffer.resize(BINARY_TURN_SIZE);
+    char *out = &buffer[0];
+    PutBinaryHeader(out, BINARY_TURN, 0);
+    out += BINARY_HEADER_SIZE;
+    PutBinaryUint64(out, message.turn.world_id_);
+    PutBinaryUint32(out + 8, message.turn.ball_id_);
+    PutBinaryDouble(out + 12, message.turn.acceleration_.a_x_);
+    PutBinaryDouble(out + 20, message.turn.acceleration_.a_y_);
+}
+
+std::string BuildBinaryTurnMessage(const TurnMessage &message) {
+    std::string buffer;
+    BuildBinaryTurnMessage(message, buffer);
+    return buffer;
+}
+
+// Replaces the contents of buffer with a KEYFRAME for world; coinId(index) is the id of world.coins[index]
+template<typename CoinIdOf>
+void BuildBinaryKeyframeMessage(const World &world, CoinIdOf coinId, std::string &buffer) {
+    buffer.resize(BINARY_STATE_HEADER_SIZE + world.balls.size() * BINARY_BALL_SIZE +
+                  world.coins.size() * BINARY_KEYED_COIN_SIZE);
+    char *out = PutBinaryStateHeader(&buffer[0], BINARY_KEYFRAME, world);
+    for (const Ball &ball : world.balls) {
+        out = PutBinaryBall(out, ball);
+    }
+    for (size_t index = 0; index < world.coins.size(); ++index) {
+        PutBinaryUint64(out, coinId(index));
+        out = PutBinaryCoin(out + BINARY_COIN_ID_SIZE, world.coins[index]);
+    }
+}
+
+// Replaces the contents of buffer with a DELTA that turns the state baseId into world; diff lists
+// the coins added and removed in between
+template<typename CoinIdOf>
+void BuildBinaryDeltaMessage(const World &world, unsigned long long baseId, CoinIdOf coinId, const WorldDiff &diff,
+                             std::string &buffer) {
+    buffer.resize(BINARY_DELTA_HEADER_SIZE + world.balls.size() * BINARY_BALL_SIZE +
+                  diff.removedCoins.size() * BINARY_COIN_ID_SIZE + diff.addedCoins.size() * BINARY_KEYED_COIN_SIZE);
+    char *out = &buffer[0];
+    PutBinaryHeader(out, BINARY_DELTA, 0);
+    out += BINARY_HEADER_SIZE;
+    PutBinaryUint64(out, world.world_id);
+    PutBinaryUint64(out + 8, baseId);
+    PutBinaryUint32(out + 16, world.balls.size());
+    PutBinaryUint32(out + 20, diff.removedCoins.size());
+    PutBinaryUint32(out + 24, diff.addedCoins.size());
+    out += BINARY_DELTA_HEADER_SIZE - BINARY_HEADER_SIZE;
+    for (const Ball &ball : world.balls) {
+        out = PutBinaryBall(out, ball);
+    }
+    for (CoinId id : diff.removedCoins) {
+        PutBinaryUint64(out, id);
+        out += BINARY_COIN_ID_SIZE;
+    }
+    for (size_t index : diff.addedCoins) {
+        PutBinaryUint64(out, coinId(index));
+        out = PutBinaryCoin(out + BINARY_COIN_ID_SIZE, world.coins[index]);
+    }
+}
+
+// Server side of the binary-delta stream: writes a KEYFRAME every keyframeInterval states and DELTAs
+// against the previous state otherwise. Coins need stable ids, either the server's own or ones
+// found by matching consecutive worlds with a WorldTracker. The latter compares every coin with the
+// previous world on each encode, so it costs O(coins) even when nothing changed; a server that
+// already knows its ids should use the overload that takes them.
+class StateStreamEncoder {
+private:
+    WorldTracker tracker_;
+    int keyframeInterval_;
+    int sinceKeyframe_;
+    bool forceKeyframe_;
+    unsigned long long previousId_;
+
+public:
+    explicit StateStreamEncoder(int keyframeInterval)
+            : tracker_(1e-9), keyframeInterval_(std::max(keyframeInterval, 1)), sinceKeyframe_(0),
+              forceKeyframe_(true), previousId_(0) { }
+
+    // The next state is sent as a keyframe, e.g. for a client that just joined
+    void requestKeyframe() {
+        forceKeyframe_ = true;
+    }
+
+    // Replaces the contents of buffer with the frame for world; returns whether it is a keyframe.
+    // Matches world against the previous one with the tracker, O(coins) per call.
+    bool encode(const World &world, std::string &buffer) {
+        const WorldDiff &diff = tracker_.update(world);
+        return encode(world, [this](size_t index) { return tracker_.coinId(index); }, diff, buffer);
+    }
+
+    // For a server that knows its coins' ids: coinId(index) is the id of world.coins[index] and
+    // diff lists the coins added and removed since the previous world passed to encode()
+    template<typename CoinIdOf>
+    bool encode(const World &world, CoinIdOf coinId, const WorldDiff &diff, std::string &buffer) {
+        bool keyframe = forceKeyframe_ || ++sinceKeyframe_ >= keyframeInterval_;
+        unsigned long long baseId = previousId_;
+        previousId_ = world.world_id;
+        if (keyframe) {
+            forceKeyframe_ = false;
+            sinceKeyframe_ = 0;
+            BuildBinaryKeyframeMessage(world, coinId, buffer);
+        } else {
+            BuildBinaryDeltaMessage(world, baseId, coinId, diff, buffer);
+        }
+        return keyframe;
+    }
+};
+
+#endif
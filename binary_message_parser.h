@@ -0,0 +1,296 @@
+#ifndef BINARY_MESSAGE_PARSER_H
+#define BINARY_MESSAGE_PARSER_H
+
+#include <cstdint>
+#include <cstring>
+
+#include <unordered_map>
+#include <vector>
+
+#include "protocol.h"
+
+// Decoders for the binary STATE and TURN layout described in protocol.h. Every read is bounds
+// checked against the frame size, so a truncated or foreign frame is rejected, never overrun.
+
+uint16_t GetBinaryUint16(const char *in) {
+    uint16_t value;
+    std::memcpy(&value, in, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap16(value);
+#endif
+    return value;
+}
+
+uint32_t GetBinaryUint32(const char *in) {
+    uint32_t value;
+    std::memcpy(&value, in, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+}
+
+uint64_t GetBinaryUint64(const char *in) {
+    uint64_t value;
+    std::memcpy(&value, in, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+double GetBinaryDouble(const char *in) {
+    uint64_t bits = GetBinaryUint64(in);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Whether data starts a binary frame of any kind, as opposed to a JSON text
+bool IsBinaryMessage(const char *data, size_t size) {
+    return size > 0 && static_cast<unsigned char>(data[0]) == BINARY_MARKER;
+}
+
+// Returns true if the header is a binary frame of the given kind and version
+bool ParseBinaryHeader(const char *data, size_t size, BinaryMessageKind kind, uint32_t &flags) {
+    if (size < BINARY_HEADER_SIZE || !IsBinaryMessage(data, size) || data[1] != kind ||
+        GetBinaryUint16(data + 2) != BINARY_VERSION) {
+        return false;
+    }
+    flags = GetBinaryUint32(data + 4);
+    return true;
+}
+
+// Reads the ids, radii and counts of a STATE or KEYFRAME whose header was checked; returns false
+// unless the frame holds exactly that many ball records and coin records of coinSize bytes
+bool GetBinaryStateHeader(const char *data, size_t size, size_t coinSize, World &world, size_t &balls_count,
+                            size_t &coins_count) {
+    if (size < BINARY_STATE_HEADER_SIZE) {
+        return false;
+    }
+    const char *in = data + BINARY_HEADER_SIZE;
+    world.world_id = GetBinaryUint64(in);
+    world.field_radius = GetBinaryDouble(in + 8);
+    world.ball_radius = GetBinaryDouble(in + 16);
+    world.coin_radius = GetBinaryDouble(in + 24);
+    world.delta_time = GetBinaryDouble(in + 32);
+    world.max_velocity = GetBinaryDouble(in + 40);
+    balls_count = GetBinaryUint32(in + 48);
+    coins_count = GetBinaryUint32(in + 52);
+    return size == BINARY_STATE_HEADER_SIZE + balls_count * BINARY_BALL_SIZE + coins_count * coinSize;
+}
+
+// Replaces the world's balls and their columns with balls_count records from in
+const char *GetBinaryBalls(const char *in, size_t balls_count, World &world) {
+    world.balls.clear();
+    world.columns.clearBalls();
+    world.balls.reserve(balls_count);
+    for (size_t index = 0; index < balls_count; ++index) {
+        world.balls.emplace_back(GetBinaryUint32(in), Point(GetBinaryDouble(in + 4), GetBinaryDouble(in + 12)),
+                                 Velocity(GetBinaryDouble(in + 20), GetBinaryDouble(in + 28)),
+                                 GetBinaryDouble(in + 36));
+        world.columns.addBall(world.balls.back());
+        in += BINARY_BALL_SIZE;
+    }
+    return in;
+}
+
+Coin GetBinaryCoin(const char *in) {
+    return Coin(Point(GetBinaryDouble(in), GetBinaryDouble(in + 8)), GetBinaryDouble(in + 16));
+}
+
+// Returns true if data is a binary STATE frame, filling world in place (ball, coin and column storage
+// is reused). On false world is left in an unspecified state.
+bool WorldStateFromBinary(const char *data, size_t size, World &world) {
+    uint32_t flags;
+    size_t balls_count, coins_count;
+    if (!ParseBinaryHeader(data, size, BINARY_STATE, flags) ||
+        !GetBinaryStateHeader(data, size, BINARY_COIN_SIZE, world, balls_count, coins_count)) {
+        return false;
+    }
+    world.columns.clear();
+    const char *in = GetBinaryBalls(data + BINARY_STATE_HEADER_SIZE, balls_count, world);
+    world.coins.clear();
+    world.coins.reserve(coins_count);
+    world.columnsSynced = true;
+    for (size_t index = 0; index < coins_count; ++index) {
+        world.coins.push_back(GetBinaryCoin(in));
+        world.columns.addCoin(world.coins.back());
+        in += BINARY_COIN_SIZE;
+    }
+    return true;
+}
+
+bool WorldStateFromBinary(const std::string &data, World &world) {
+    return WorldStateFromBinary(data.data(), data.size(), world);
+}
+
+bool TurnFromBinary(const char *data, size_t size, Turn &turn) {
+    uint32_t flags;
+    if (!ParseBinaryHeader(data, size, BINARY_TURN, flags) || size != BINARY_TURN_SIZE) {
+        return false;
+    }
+    const char *in = data + BINARY_HEADER_SIZE;
+    turn = Turn(GetBinaryUint64(in), GetBinaryUint32(in + 8),
+                Acceleration(GetBinaryDouble(in + 12), GetBinaryDouble(in + 20)));
+    return true;
+}
+
+bool TurnFromBinary(const std::string &data, Turn &turn) {
+    return TurnFromBinary(data.data(), data.size(), turn);
+}
+
+// Whether data is a KEYFRAME or DELTA of the binary-delta stream
+bool IsStateStreamMessage(const char *data, size_t size) {
+    return size >= BINARY_HEADER_SIZE && IsBinaryMessage(data, size) &&
+           (data[1] == BINARY_KEYFRAME || data[1] == BINARY_DELTA);
+}
+
+// Client side of the binary-delta stream: keeps the last world and applies every DELTA to it in
+// place, removing coins by swap-and-pop. A DELTA whose base is not the current world means states
+// were lost; the decoder then ignores DELTAs until the next KEYFRAME.
+class StateStreamDecoder {
+public:
+    enum Result {
+        APPLIED,
+        GAP,      // waiting for a keyframe
+        MALFORMED
+    };
+
+private:
+    World world_;
+    std::vector<uint64_t> coinIds_;                 // id of world_.coins[i]
+    std::unordered_map<uint64_t, size_t> coinIndex_; // inverse of coinIds_
+    bool synced_;
+    size_t gaps_;
+
+    // False if a coin with that id is already present
+    bool addCoin(uint64_t id, const Coin &coin) {
+        if (coinIndex_.count(id)) {
+            return false;
+        }
+        coinIndex_[id] = world_.coins.size();
+        coinIds_.push_back(id);
+        world_.coins.push_back(coin);
+        world_.columns.addCoin(coin);
+        return true;
+    }
+
+    bool removeCoin(uint64_t id) {
+        auto found = coinIndex_.find(id);
+        if (found == coinIndex_.end()) {
+            return false;
+        }
+        size_t index = found->second;
+        size_t last = world_.coins.size() - 1;
+        coinIndex_.erase(found);
+        if (index != last) {
+            world_.coins[index] = world_.coins[last];
+            coinIds_[index] = coinIds_[last];
+            coinIndex_[coinIds_[index]] = index;
+        }
+        world_.coins.pop_back();
+        coinIds_.pop_back();
+        world_.columns.removeCoin(index);
+        return true;
+    }
+
+    Result applyKeyframe(const char *data, size_t size) {
+        size_t balls_count, coins_count;
+        if (!GetBinaryStateHeader(data, size, BINARY_KEYED_COIN_SIZE, world_, balls_count, coins_count)) {
+            return MALFORMED;
+        }
+        world_.columns.clear();
+        const char *in = GetBinaryBalls(data + BINARY_STATE_HEADER_SIZE, balls_count, world_);
+        world_.coins.clear();
+        coinIds_.clear();
+        coinIndex_.clear();
+        world_.coins.reserve(coins_count);
+        for (size_t index = 0; index < coins_count; ++index) {
+            if (!addCoin(GetBinaryUint64(in), GetBinaryCoin(in + BINARY_COIN_ID_SIZE))) {
+                return MALFORMED;
+            }
+            in += BINARY_KEYED_COIN_SIZE;
+        }
+        synced_ = true;
+        return APPLIED;
+    }
+
+    Result applyDelta(const char *data, size_t size) {
+        if (size < BINARY_DELTA_HEADER_SIZE) {
+            return MALFORMED;
+        }
+        const char *in = data + BINARY_HEADER_SIZE;
+        unsigned long long state_id = GetBinaryUint64(in);
+        unsigned long long base_id = GetBinaryUint64(in + 8);
+        size_t balls_count = GetBinaryUint32(in + 16);
+        size_t removed_count = GetBinaryUint32(in + 20);
+        size_t added_count = GetBinaryUint32(in + 24);
+        if (size != BINARY_DELTA_HEADER_SIZE + balls_count * BINARY_BALL_SIZE +
+                    removed_count * BINARY_COIN_ID_SIZE + added_count * BINARY_KEYED_COIN_SIZE) {
+            return MALFORMED;
+        }
+        if (!synced_ || base_id != world_.world_id) {
+            if (synced_) {
+                ++gaps_;
+            }
+            synced_ = false;
+            return GAP;
+        }
+        world_.world_id = state_id;
+        in = GetBinaryBalls(data + BINARY_DELTA_HEADER_SIZE, balls_count, world_);
+        for (size_t index = 0; index < removed_count; ++index) {
+            if (!removeCoin(GetBinaryUint64(in))) {
+                return MALFORMED;
+            }
+            in += BINARY_COIN_ID_SIZE;
+        }
+        for (size_t index = 0; index < added_count; ++index) {
+            if (!addCoin(GetBinaryUint64(in), GetBinaryCoin(in + BINARY_COIN_ID_SIZE))) {
+                return MALFORMED;
+            }
+            in += BINARY_KEYED_COIN_SIZE;
+        }
+        return APPLIED;
+    }
+
+public:
+    // Every change to the world's balls and coins below updates its columns as well
+    StateStreamDecoder() : synced_(false), gaps_(0) {
+        world_.columnsSynced = true;
+    }
+
+    Result apply(const char *data, size_t size) {
+        uint32_t flags;
+        Result result = MALFORMED;
+        if (ParseBinaryHeader(data, size, BINARY_KEYFRAME, flags)) {
+            result = applyKeyframe(data, size);
+        } else if (ParseBinaryHeader(data, size, BINARY_DELTA, flags)) {
+            result = applyDelta(data, size);
+        }
+        if (result == MALFORMED) {
+            synced_ = false; // the world may be half updated
+        }
+        return result;
+    }
+
+    Result apply(const std::string &data) {
+        return apply(data.data(), data.size());
+    }
+
+    // The world after the last applied frame; coins are not in the server's order
+    const World &world() const {
+        return world_;
+    }
+
+    bool synced() const {
+        return synced_;
+    }
+
+    // Times a delta did not follow the world it was based on
+    size_t gaps() const {
+        return gaps_;
+    }
+};
+
+#endif
@@ -2,6 +2,10 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <iostream>
@@ -9,10 +13,22 @@
 #include <sstream>
 #include <assert.h>
 #include <stdexcept>
+#include <cerrno>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 #include "action_manager.h"
+#include "frame_buffer.h"
+#include "spsc_queue.h"
+#include "turn_watchdog.h"
+#include "latency_stats.h"
+#include "logger.h"
 #include "message_builder.h"
 #include "message_parser.h"
+#include "binary_message_builder.h"
+#include "binary_message_parser.h"
+#include "world_state_parser.h"
 // #include "viewer.h"
 
 #pragma once
@@ -22,14 +38,27 @@ protected:
     ActionManager actionManager_;
     size_t id_;
     int sock_;
+    FrameReceiveBuffer receiveBuffer_;
+    rapidjson::StringBuffer sendBuffer_;
+    std::string binarySendBuffer_;
+    bool binaryEncoding_; // the server agreed to binary STATE and TURN frames
+    bool deltaStates_;    // the server agreed to send keyframes and deltas
+    StateStreamDecoder stateStream_;
+    std::vector<FrameView> pendingFrames_; // popped by recvLatestFrame, valid until the next fill
+    size_t nextPendingFrame_;
+    size_t lastPendingState_;              // index of the newest state frame in pendingFrames_
 
 public:
     explicit Client(const ActionManager &actionManager) :
-            actionManager_(actionManager) {
+            actionManager_(actionManager), binaryEncoding_(false), deltaStates_(false), nextPendingFrame_(0),
+            lastPendingState_(0) {
         sock_ = socket(AF_INET, SOCK_STREAM, 0);
         if (sock_ < 0) {
             throw std::runtime_error("Error: failed to create socket");
         }
+        // Turns are tiny and latency bound: do not let Nagle hold them back
+        int no_delay = 1;
+        setsockopt(sock_, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
     }
 
     virtual ~Client() {
@@ -51,22 +80,22 @@ protected:
         addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
         do {
             connected = connect(sock_, (struct sockaddr *) &addr, sizeof(addr));
-            std::cout << "Connection..." << std::endl;
+            LOG_INFO("Connection...");
         } while (connected < 0);
 
         std::string message_to = MessageToJson(&request_message);
         int send = sendString(message_to);
         if (send != message_to.size() + sizeof(uint32_t)) {
-            std::cout << "Error: can not send request message to server" << std::endl;
+            LOG_ERROR("Error: can not send request message to server");
             return false;
         }
 
         // Obtaining answer
         std::string message_from;
         int recv = recvString(message_from);
-        std::cout << message_from << std::endl;
+        LOG_DEBUG("%s", message_from.c_str());
         if (recv < 0) {
-            std::cout << "Error: can not recv request message from server" << std::endl;
+            LOG_ERROR("Error: can not recv request message from server");
             return false;
         }
 
@@ -78,124 +107,625 @@ protected:
                 (dynamic_cast<AnswerMessage *>(message.release()));
 
         if (!subscribe_result_message) {
-            std::cout << "Error : bad response type" << std::endl;
+            LOG_ERROR("Error: bad response type");
             return false;
         }
 
         if (!subscribe_result_message->result) {
-            std::cout << "Error: server refused to accept gamer" << std::endl;
+            LOG_ERROR("Error: server refused to accept gamer");
             return false;
         }
         id_ = subscribe_result_message->id();
-        std::cout << "Gamer connected to server with id = " << id_ << std::endl;
+        acceptEncoding(*subscribe_result_message);
+        LOG_INFO("Gamer connected to server with id = %zu", id_);
         return true;
     }
 
+    void acceptEncoding(const GamerSubscribeResultMessage &message) {
+        deltaStates_ = message.encoding == mBinaryDeltaEncoding;
+        binaryEncoding_ = deltaStates_ || message.encoding == mBinaryEncoding;
+        if (binaryEncoding_) {
+            LOG_INFO("Server speaks the binary protocol%s", deltaStates_ ? " with delta states" : "");
+        }
+    }
+
+    void acceptEncoding(const ViewerSubscribeResultMessage &) {
+    }
+
     virtual bool connectToServer(size_t port) = 0;
 
-    bool isFinishConnectionMessage(const std::string &finish_message_str) {
-        std::unique_ptr<Message> message = MessageFromJson(finish_message_str);
-        if (message->type != mFinishType) {
-            return false;
+    enum class ServerMessageKind {
+        FINISH,
+        WORLD_STATE,
+        OTHER
+    };
+
+    // STATE messages are parsed straight into the caller's world, other types fall back to MessageFromJson.
+    // Binary frames are recognised by their first byte whatever encoding was negotiated.
+    // Keyframes and deltas update the persistent stream world; it is copied into world unless the
+    // caller passes stream_world to read it in place.
+    ServerMessageKind readServerMessage(const FrameView &frame, World &world, const World **stream_world = nullptr) {
+        if (IsStateStreamMessage(frame.data, frame.size)) {
+            if (!applyStateStream(frame)) {
+                return ServerMessageKind::OTHER;
+            }
+            if (stream_world) {
+                *stream_world = &stateStream_.world();
+            } else {
+                world = stateStream_.world();
+            }
+            return ServerMessageKind::WORLD_STATE;
         }
-        std::cout << "Finish connection" << std::endl;
-        return true;
+        if (IsBinaryMessage(frame.data, frame.size)) {
+            return WorldStateFromBinary(frame.data, frame.size, world) ?
+                   ServerMessageKind::WORLD_STATE : ServerMessageKind::OTHER;
+        }
+        if (WorldStateFromJson(frame.data, frame.size, world)) {
+            return ServerMessageKind::WORLD_STATE;
+        }
+        std::string message_str = frame.str();
+        std::unique_ptr<Message> message = MessageFromJson(message_str);
+        if (message->type == mFinishType) {
+            LOG_INFO("Finish connection");
+            return ServerMessageKind::FINISH;
+        }
+        if (message->type != mWorldStateType) {
+            return ServerMessageKind::OTHER;
+        }
+        WorldStateMessage *world_state_message = static_cast<WorldStateMessage *>(message.get());
+        world = std::move(world_state_message->world);
+        return ServerMessageKind::WORLD_STATE;
     }
 
-    bool isWorldStateMessage(const std::string &world_state_message_str, World &world) {
-        std::unique_ptr<Message> message = MessageFromJson(world_state_message_str);
-        if (message->type != mWorldStateType) {
-            return false;
+    // Applies a keyframe or delta to the persistent stream world; false while waiting for a keyframe
+    bool applyStateStream(const FrameView &frame) {
+        StateStreamDecoder::Result result = stateStream_.apply(frame.data, frame.size);
+        if (result == StateStreamDecoder::GAP) {
+            LOG_DEBUG("Delta state does not follow state %llu, waiting for a keyframe", stateStream_.world().world_id);
+        } else if (result == StateStreamDecoder::MALFORMED) {
+            LOG_WARNING("Malformed keyframe or delta state");
         }
-        std::unique_ptr<WorldStateMessage> world_state_message
-                (dynamic_cast<WorldStateMessage *>(message.release()));
-        world = world_state_message->world;
-        return true;
+        return result == StateStreamDecoder::APPLIED;
+    }
+
+    // A frame that is dropped without planning a turn for it. Deltas still have to be applied,
+    // otherwise every later delta would wait for the next keyframe.
+    void skipFrame(const FrameView &frame) {
+        if (IsStateStreamMessage(frame.data, frame.size)) {
+            applyStateStream(frame);
+        }
+    }
+
+    int sendFrame(const char *data, size_t size) {
+        return SendFrame(sock_, data, size);
     }
 
     int sendString(const std::string &str) {
-        std::cout << "Client send " << str << std::endl;
-        u_int32_t message_length = str.size();
-        char *message_length_str = (char *)(&message_length);
-        std::string full_str = std::string(message_length_str,
-                                           message_length_str + sizeof(message_length)) + str;
-        int total_sent = 0;
+        return sendFrame(str.data(), str.size());
+    }
+
+    // Returns the next frame, receiving only when no complete frame is buffered yet.
+    // The frame points into receiveBuffer_ and stays valid until the next call.
+    bool recvFrame(FrameView &frame) {
+        while (!receiveBuffer_.popFrame(frame)) {
+            ssize_t reads = receiveBuffer_.fill(sock_);
+            if (reads < 0 && errno == EINTR) {
+                continue;
+            }
+            if (reads <= 0) {
+                return false;
+            }
+        }
+        LOG_DEBUG("Client read %.*s", static_cast<int>(frame.size), frame.data);
+        return true;
+    }
+
+    // Whether the frame carries a world: a STATE in any encoding, a KEYFRAME or a DELTA
+    static bool isStateFrame(const FrameView &frame) {
+        if (IsBinaryMessage(frame.data, frame.size)) {
+            return frame.size >= BINARY_HEADER_SIZE &&
+                   (frame.data[1] == BINARY_STATE || IsStateStreamMessage(frame.data, frame.size));
+        }
+        return IsWorldStateJson(frame.data, frame.size);
+    }
+
+    // Pops every buffered frame into frames; returns the index of the last state frame among them,
+    // frames.size() if there is none
+    size_t popBufferedFrames(std::vector<FrameView> &frames) {
+        frames.clear();
+        FrameView frame;
+        while (receiveBuffer_.popFrame(frame)) {
+            frames.push_back(frame);
+        }
+        for (size_t index = frames.size(); index > 0; --index) {
+            if (isStateFrame(frames[index - 1])) {
+                return index - 1;
+            }
+        }
+        return frames.size();
+    }
+
+    // Pulls everything the socket already holds, then returns the buffered frames in order, except
+    // state frames followed by a newer one: those are dropped unparsed and counted in skipped.
+    bool recvLatestFrame(FrameView &frame, size_t &skipped) {
         while (true) {
-            int sent = send(sock_, full_str.c_str() + total_sent, full_str.size() - total_sent, 0);
-            if (sent <= 0) {
-                break;
+            while (nextPendingFrame_ < pendingFrames_.size()) {
+                size_t index = nextPendingFrame_++;
+                if (index < lastPendingState_ && isStateFrame(pendingFrames_[index])) {
+                    skipFrame(pendingFrames_[index]);
+                    ++skipped;
+                    continue;
+                }
+                frame = pendingFrames_[index];
+                return true;
+            }
+
+            ssize_t reads;
+            do {
+                reads = receiveBuffer_.fill(sock_, MSG_DONTWAIT);
+            } while (reads > 0 || (reads < 0 && errno == EINTR));
+            lastPendingState_ = popBufferedFrames(pendingFrames_);
+            nextPendingFrame_ = 0;
+            if (!pendingFrames_.empty()) {
+                continue;
+            }
+            if (reads == 0) {
+                return false;
+            }
+            reads = receiveBuffer_.fill(sock_);
+            if (reads < 0 && errno == EINTR) {
+                continue;
             }
-            total_sent += sent;
+            if (reads <= 0) {
+                return false;
+            }
+            lastPendingState_ = popBufferedFrames(pendingFrames_);
         }
-        return total_sent;
     }
 
     int recvString(std::string &str) {
-        char buf_length[sizeof(u_int32_t)];
-        int message_length_length = recv(sock_, buf_length, sizeof(u_int32_t), 0);
-        if (message_length_length < 0) {
+        FrameView frame;
+        if (!recvFrame(frame)) {
             return -1;
         }
-        size_t message_length = *(u_int32_t *)buf_length;
-        char buf[10240];
-        int total_reads = 0;
-        while (total_reads < message_length) {
-            int reads = recv(sock_, buf, 10240, 0);
-            if (reads < 0) {
-                return -1;
-            }
-            str = std::string(buf, reads);
-            total_reads += reads;
+        str.assign(frame.data, frame.size);
+        return frame.size;
+    }
+};
+
+struct GamerSettings {
+    // Answer only the newest STATE when the bot falls behind the server
+    bool coalesceStates;
+    // Receive and parse on the calling thread while a second thread plans turns
+    bool pipeline;
+    // Time allowed for planning one turn before a fallback turn is sent, 0 for no limit
+    long turnBudgetUs;
+    // Period of turn latency reports, 0 to report only when the game ends
+    long statsIntervalSec;
+    // Shorten the planned route while waiting for the next state
+    bool improveRoutes;
+    // Offer the binary encoding when subscribing, JSON is used if the server does not accept it
+    bool binaryProtocol;
+    // Offer the binary keyframe and delta stream, before the plain binary encoding if that is offered too
+    bool deltaStates;
+
+    GamerSettings() : coalesceStates(false), pipeline(false), turnBudgetUs(0), statsIntervalSec(0),
+                      improveRoutes(false), binaryProtocol(false), deltaStates(false) { }
+};
+
+// Hand-off between the network thread and the planning thread of a pipelined Gamer. Worlds that do
+// not fit into the queue go to a single latest-world slot, where each one replaces the previous,
+// so the planner always gets to the newest state however far behind it is.
+struct TurnPipeline {
+    SpscQueue<World> worlds;      // network -> planner
+    SpscQueue<World> spareWorlds; // planner -> network, so parsed worlds keep their storage
+    SpscQueue<TurnMessage> turns; // planner -> network
+    int worldsReady;              // eventfd doorbells for the queues above
+    int turnsReady;
+    std::atomic<bool> finished;
+    size_t skippedByPlanner;      // read by the network thread only after joining the planner
+
+    std::mutex latestMutex;       // guards latest
+    World latest;                 // newer than every queued world while hasLatest is set
+    std::atomic<bool> hasLatest;  // written under latestMutex
+
+    explicit TurnPipeline(size_t capacity)
+            : worlds(capacity), spareWorlds(capacity + 2), turns(capacity),
+              worldsReady(eventfd(0, 0)), turnsReady(eventfd(0, 0)), finished(false), skippedByPlanner(0),
+              hasLatest(false) {
+        if (worldsReady < 0 || turnsReady < 0) {
+            throw std::runtime_error("Error: failed to create eventfd");
         }
-        std::cout << "Client read " << str << std::endl;
-        return total_reads;
+    }
+
+    ~TurnPipeline() {
+        close(worldsReady);
+        close(turnsReady);
+    }
+
+    // Network side: queues world, or puts it into the latest slot if the queue is full or the slot is
+    // taken already, to keep the queue older than the slot. Returns whether that evicted an unplanned
+    // world; world is left with some unused storage either way.
+    bool push(World &world) {
+        if (!hasLatest && worlds.tryPush(std::move(world))) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(latestMutex);
+        bool evicted = hasLatest;
+        std::swap(latest, world);
+        hasLatest = true;
+        return evicted;
+    }
+
+    // Planner side: the oldest world not planned yet; queued ones come before the latest slot
+    bool pop(World &world) {
+        if (worlds.tryPop(world)) {
+            return true;
+        }
+        if (!hasLatest) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(latestMutex);
+        std::swap(latest, world);
+        hasLatest = false;
+        return true;
+    }
+
+    bool hasWorlds() const {
+        return hasLatest || !worlds.empty();
+    }
+
+    static void notify(int fd) {
+        uint64_t one = 1;
+        while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR) { }
+    }
+
+    static void wait(int fd) {
+        uint64_t count;
+        while (read(fd, &count, sizeof(count)) < 0 && errno == EINTR) { }
     }
 };
 
 class Gamer : public Client {
+private:
+    typedef TurnLatencyStats::Clock Clock;
+
+    enum {
+        PIPELINE_QUEUE_SIZE = 4,
+        TURN_STARTS_SIZE = 64
+    };
+
+    GamerSettings settings_;
+    size_t skippedStates_;
+    std::unique_ptr<TurnWatchdog> watchdog_;
+
+    TurnLatencyStats stats_;
+    Clock::time_point lastStatsDump_;
+    // Parse start of recent states by world_id, to measure whole turns in the pipelined mode
+    std::pair<unsigned long long, Clock::time_point> turnStarts_[TURN_STARTS_SIZE];
+
 public:
-    explicit Gamer(const ActionManager &actionManager) :
-            Client(actionManager) { }
+    explicit Gamer(const ActionManager &actionManager, const GamerSettings &settings = GamerSettings()) :
+            Client(actionManager), settings_(settings), skippedStates_(0), lastStatsDump_(Clock::now()) {
+        if (settings_.turnBudgetUs > 0) {
+            watchdog_.reset(new TurnWatchdog(actionManager_, std::chrono::microseconds(settings_.turnBudgetUs)));
+        }
+    }
 
     void run(size_t port) {
         if (!connectToServer(port)) {
             return;
         }
-        std::string message_str;
-        while (recvString(message_str) >= 0) {
-            World world_state;
-            if (isFinishConnectionMessage(message_str)) {
-                return;
-            } else if (isWorldStateMessage(message_str, world_state)) {
-                std::string turn_answer;
-                performTurn(world_state, turn_answer);
-                int send = sendString(turn_answer);
-                if (send < 0) {
-                    std::cout << "Error: can not send turn message to server" << std::endl;
-                    continue;
+        if (settings_.pipeline) {
+            runPipelined();
+            return;
+        }
+        FrameView frame;
+        World world_state;
+        Clock::time_point recv_start = Clock::now();
+        while (nextFrame(frame)) {
+            Clock::time_point turn_start = Clock::now();
+            stats_.record(STAGE_RECV, recv_start, turn_start);
+            // The watchdog takes the world over, so only plain planning may read the stream world in place
+            const World *stream_world = nullptr;
+            ServerMessageKind kind = readServerMessage(frame, world_state, watchdog_ ? nullptr : &stream_world);
+            stats_.record(STAGE_PARSE, turn_start, Clock::now());
+            if (kind == ServerMessageKind::FINISH) {
+                break;
+            } else if (kind == ServerMessageKind::WORLD_STATE) {
+                double tick_seconds = world_state.delta_time;
+                if (stream_world) {
+                    tick_seconds = stream_world->delta_time;
+                    performTurn(*stream_world);
+                } else {
+                    performTurn(world_state);
                 }
+                int send;
+                {
+                    StageTimer timer(stats_, STAGE_SEND);
+                    send = sendTurn();
+                }
+                stats_.record(STAGE_TURN, turn_start, Clock::now());
+                if (send <= 0) {
+                    LOG_ERROR("Error: can not send turn message to server");
+                }
+                improvePlan(turn_start, tick_seconds, [this]() {
+                    return receiveBuffer_.hasFrame() || socketReadable();
+                });
             }
+            dumpStatsPeriodically();
+            recv_start = Clock::now();
         }
+        printSummary();
     }
 
 private:
     virtual bool connectToServer(size_t port) {
-        return subscribeForServer(port, GamerSubscribeRequestMessage());
+        GamerSubscribeRequestMessage request;
+        if (settings_.deltaStates) {
+            request.capabilities.push_back(mBinaryDeltaEncoding);
+        }
+        if (settings_.binaryProtocol) {
+            request.capabilities.push_back(mBinaryEncoding);
+        }
+        return subscribeForServer(port, request);
     }
 
-    void performTurn(const World &world, std::string &turn_answer) {
-        TurnMessage turn_message;
+    bool nextFrame(FrameView &frame) {
+        if (settings_.coalesceStates) {
+            return recvLatestFrame(frame, skippedStates_);
+        }
+        return recvFrame(frame);
+    }
+
+    // With a turn budget the world is handed to the watchdog and replaced by spare storage
+    void planTurn(World &world, TurnMessage &turn_message) {
+        if (!watchdog_) {
+            planTurn(static_cast<const World &>(world), turn_message);
+            return;
+        }
+        actionManager_.setTurnDeadline(Clock::now() + std::chrono::microseconds(settings_.turnBudgetUs));
+        turn_message.turn.ball_id_ = id_;
+        turn_message.turn.world_id_ = world.world_id;
+        for (size_t ball_index = 0; ball_index < world.balls.size(); ++ball_index) {
+            if (world.balls[ball_index].id_ == id_) {
+                turn_message.turn.acceleration_ = watchdog_->performGamerAction(world, ball_index);
+                LOG_DEBUG("Acceleration: %f %f", turn_message.turn.acceleration_.a_x_, turn_message.turn.acceleration_.a_y_);
+                break;
+            }
+        }
+    }
+
+    // Without a turn budget planning only reads the world, e.g. the delta stream's one in place
+    void planTurn(const World &world, TurnMessage &turn_message) {
+        assert(!watchdog_);
         turn_message.turn.ball_id_ = id_;
         turn_message.turn.world_id_ = world.world_id;
         for (const Ball &ball : world.balls) {
             if (ball.id_ == id_) {
                 turn_message.turn.acceleration_ = actionManager_.performGamerAction(world, ball);
-                std::cerr << turn_message.turn.acceleration_.a_x_ << " " << turn_message.turn.acceleration_.a_y_ << std::endl;
-                //turn_message.turn.acceleration_ = Acceleration(0.0, 0.1);
+                LOG_DEBUG("Acceleration: %f %f", turn_message.turn.acceleration_.a_x_, turn_message.turn.acceleration_.a_y_);
                 break;
             }
         }
-        turn_answer = MessageToJson(&turn_message);
+    }
+
+    bool socketReadable() const {
+        struct pollfd fd;
+        fd.fd = sock_;
+        fd.events = POLLIN;
+        return poll(&fd, 1, 0) > 0;
+    }
+
+    // Uses the rest of the tick that started at turn_start to improve the global plan,
+    // until the tick is over or interrupted() reports that a newer state has come
+    template<typename Interrupted>
+    void improvePlan(Clock::time_point turn_start, double tick_seconds, Interrupted interrupted) {
+        if (!settings_.improveRoutes || tick_seconds <= 0 || (watchdog_ && watchdog_->busy())) {
+            return;
+        }
+        Clock::time_point deadline =
+                turn_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(tick_seconds));
+        actionManager_.improvePlan([&]() {
+            return Clock::now() >= deadline || interrupted();
+        });
+    }
+
+    // Leaves the serialized turn for sendTurn(); WorldType is World, or const World without a watchdog
+    template<typename WorldType>
+    void performTurn(WorldType &world) {
+        TurnMessage turn_message;
+        {
+            StageTimer timer(stats_, STAGE_PLAN);
+            planTurn(world, turn_message);
+        }
+        StageTimer timer(stats_, STAGE_SERIALIZE);
+        serializeTurn(turn_message);
+    }
+
+    void serializeTurn(const TurnMessage &turn_message) {
+        if (binaryEncoding_) {
+            BuildBinaryTurnMessage(turn_message, binarySendBuffer_);
+        } else {
+            BuildTurnMessage(turn_message, sendBuffer_);
+        }
+    }
+
+    int sendTurn() {
+        if (binaryEncoding_) {
+            return sendFrame(binarySendBuffer_.data(), binarySendBuffer_.size());
+        }
+        return sendFrame(sendBuffer_.GetString(), sendBuffer_.GetSize());
+    }
+
+    void dumpStatsPeriodically() {
+        if (settings_.statsIntervalSec <= 0) {
+            return;
+        }
+        Clock::time_point now = Clock::now();
+        if (now - lastStatsDump_ >= std::chrono::seconds(settings_.statsIntervalSec)) {
+            lastStatsDump_ = now;
+            stats_.dump(std::cout);
+        }
+    }
+
+    void printSummary() {
+        if (settings_.coalesceStates || settings_.pipeline) {
+            std::cout << "Skipped " << skippedStates_ << " stale states" << std::endl;
+        }
+        if (watchdog_) {
+            std::cout << "Missed " << watchdog_->missedDeadlines() << " turn deadlines" << std::endl;
+        }
+        if (deltaStates_) {
+            std::cout << "Lost " << stateStream_.gaps() << " delta states" << std::endl;
+        }
+        stats_.dump(std::cout);
+    }
+
+    // Network thread: polls the socket and the planner's doorbell, parses states and sends planned turns
+    void runPipelined() {
+        TurnPipeline pipeline(PIPELINE_QUEUE_SIZE);
+        std::thread planner(&Gamer::planTurns, this, std::ref(pipeline));
+        // Stops and joins the planner however this function is left, e.g. when a parser throws;
+        // destroying a joinable std::thread would terminate the process
+        struct PlannerStopper {
+            TurnPipeline &pipeline;
+            std::thread &planner;
+
+            void stop() {
+                if (planner.joinable()) {
+                    pipeline.finished = true;
+                    TurnPipeline::notify(pipeline.worldsReady);
+                    planner.join();
+                }
+            }
+
+            ~PlannerStopper() {
+                stop();
+            }
+        } stopper = {pipeline, planner};
+
+        struct pollfd fds[2];
+        fds[0].fd = sock_;
+        fds[0].events = POLLIN;
+        fds[1].fd = pipeline.turnsReady;
+        fds[1].events = POLLIN;
+
+        World world_state;
+        std::vector<FrameView> frames;
+        bool finished = false;
+        bool closed = false;
+        while (!finished) {
+            // Frames may already be buffered, e.g. a STATE that came together with the subscribe answer
+            size_t last_state = popBufferedFrames(frames);
+            for (size_t index = 0; index < frames.size() && !finished; ++index) {
+                const FrameView &frame = frames[index];
+                if (settings_.coalesceStates && index < last_state && isStateFrame(frame)) {
+                    skipFrame(frame);
+                    ++skippedStates_;
+                    continue;
+                }
+                Clock::time_point parse_start = Clock::now();
+                ServerMessageKind kind = readServerMessage(frame, world_state);
+                stats_.record(STAGE_PARSE, parse_start, Clock::now());
+                if (kind == ServerMessageKind::FINISH) {
+                    finished = true;
+                } else if (kind == ServerMessageKind::WORLD_STATE) {
+                    turnStarts_[world_state.world_id % TURN_STARTS_SIZE] =
+                            std::make_pair(world_state.world_id, parse_start);
+                    if (pipeline.push(world_state)) {
+                        ++skippedStates_;
+                    }
+                    TurnPipeline::notify(pipeline.worldsReady);
+                    pipeline.spareWorlds.tryPop(world_state);
+                }
+            }
+            if (finished || closed) {
+                break;
+            }
+
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            if (fds[1].revents & POLLIN) {
+                TurnPipeline::wait(pipeline.turnsReady);
+                sendPlannedTurns(pipeline);
+            }
+            if (fds[0].revents != 0) {
+                StageTimer timer(stats_, STAGE_RECV);
+                ssize_t reads;
+                do {
+                    reads = receiveBuffer_.fill(sock_, MSG_DONTWAIT);
+                } while (reads > 0 || (reads < 0 && errno == EINTR));
+                closed = reads == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+            }
+            dumpStatsPeriodically();
+        }
+
+        stopper.stop();
+        skippedStates_ += pipeline.skippedByPlanner;
+        printSummary();
+    }
+
+    // Planning thread: turns every queued world into a TurnMessage
+    void planTurns(TurnPipeline &pipeline) {
+        World world;
+        World newer;
+        while (true) {
+            while (pipeline.pop(world)) {
+                while (settings_.coalesceStates && pipeline.pop(newer)) {
+                    std::swap(world, newer);
+                    pipeline.spareWorlds.tryPush(std::move(newer));
+                    ++pipeline.skippedByPlanner;
+                }
+                TurnMessage turn_message;
+                double tick_seconds = world.delta_time;
+                Clock::time_point plan_start = Clock::now();
+                {
+                    StageTimer timer(stats_, STAGE_PLAN);
+                    planTurn(world, turn_message);
+                }
+                if (pipeline.turns.tryPush(std::move(turn_message))) {
+                    TurnPipeline::notify(pipeline.turnsReady);
+                } else {
+                    LOG_ERROR("Error: turn queue is full, dropping turn");
+                }
+                pipeline.spareWorlds.tryPush(std::move(world));
+                improvePlan(plan_start, tick_seconds, [&pipeline]() {
+                    return pipeline.hasWorlds() || pipeline.finished;
+                });
+            }
+            if (pipeline.finished) {
+                return;
+            }
+            TurnPipeline::wait(pipeline.worldsReady);
+        }
+    }
+
+    void sendPlannedTurns(TurnPipeline &pipeline) {
+        TurnMessage turn_message;
+        while (pipeline.turns.tryPop(turn_message)) {
+            {
+                StageTimer timer(stats_, STAGE_SERIALIZE);
+                serializeTurn(turn_message);
+            }
+            int send;
+            {
+                StageTimer timer(stats_, STAGE_SEND);
+                send = sendTurn();
+            }
+            const std::pair<unsigned long long, Clock::time_point> &turn_start =
+                    turnStarts_[turn_message.turn.world_id_ % TURN_STARTS_SIZE];
+            if (turn_start.first == turn_message.turn.world_id_) {
+                stats_.record(STAGE_TURN, turn_start.second, Clock::now());
+            }
+            if (send <= 0) {
+                LOG_ERROR("Error: can not send turn message to server");
+            }
+        }
     }
 };
 /*
@@ -211,13 +741,14 @@ public:
             return;
         }
         bool show_first_time = true;
-        std::string message_str;
-        while (recvString(message_str) >= 0) {
-            World world_state;
-            if (isFinishConnectionMessage(message_str)) {
+        FrameView frame;
+        World world_state;
+        while (recvFrame(frame)) {
+            ServerMessageKind kind = readServerMessage(frame, world_state);
+            if (kind == ServerMessageKind::FINISH) {
                 notifier_->finishShowing();
                 return;
-            } else if (isWorldStateMessage(message_str, world_state)) {
+            } else if (kind == ServerMessageKind::WORLD_STATE) {
                 performView(world_state, show_first_time);
             }
         }
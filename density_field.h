@@ -0,0 +1,226 @@
+#ifndef DENSITY_FIELD_H
+#define DENSITY_FIELD_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "game_objects.h"
+
+// Per-tick grid of ball positions for density-aware coin scoring. Balls are splatted bilinearly
+// onto cell centres and blurred with a separable Gaussian for smooth density lookups, and a
+// summed-area table of per-cell ball counts answers how many balls lie in a box. Both lookups are
+// O(1) per coin, at the price of the positions being resolved only to cell size.
+class DensityField {
+private:
+    enum {
+        MAX_CELLS_PER_SIDE = 256,
+        KERNEL_RADIUS_SIGMAS = 3,
+        CELLS_PER_SIGMA = 4
+    };
+
+    double sigma_;            // Gaussian width in world units, 0 if only box counts are needed
+    double minX_;
+    double minY_;
+    double cellSize_;
+    double inverseCellSize_;
+    int cells_;               // cells per side
+    std::vector<double> counts_;    // balls per cell, row-major
+    std::vector<double> splats_;    // balls spread over the four nearest cell centres
+    std::vector<double> smoothed_;  // splats_ blurred with the Gaussian
+    std::vector<double> areaTable_; // (cells_ + 1)^2 prefix sums of counts_
+    std::vector<double> taps_;      // Gaussian weights at 0, 1, 2... cells
+    std::vector<double> rowPass_;
+    std::vector<char> rowHasBalls_;
+    bool built_;
+    unsigned long long worldId_;
+    size_t ballsCount_;
+
+    int clampCell(double value) const {
+        int cell = static_cast<int>(std::floor(value));
+        return std::min(std::max(cell, 0), cells_ - 1);
+    }
+
+    void splat(const World &world) {
+        splats_.assign(cells_ * cells_, 0);
+        rowHasBalls_.assign(cells_, 0);
+        for (const Ball &ball : world.balls) {
+            double fx = (ball.position_.x_ - minX_) * inverseCellSize_ - 0.5;
+            double fy = (ball.position_.y_ - minY_) * inverseCellSize_ - 0.5;
+            int x0 = static_cast<int>(std::floor(fx));
+            int y0 = static_cast<int>(std::floor(fy));
+            double tx = fx - x0;
+            double ty = fy - y0;
+            for (int dy = 0; dy < 2; ++dy) {
+                int y = std::min(std::max(y0 + dy, 0), cells_ - 1);
+                double wy = dy ? ty : 1 - ty;
+                for (int dx = 0; dx < 2; ++dx) {
+                    int x = std::min(std::max(x0 + dx, 0), cells_ - 1);
+                    splats_[y * cells_ + x] += wy * (dx ? tx : 1 - tx);
+                }
+                rowHasBalls_[y] = 1;
+            }
+        }
+    }
+
+    void blur() {
+        int radius = taps_.size() - 1;
+        rowPass_.assign(splats_.size(), 0);
+        for (int y = 0; y < cells_; ++y) {
+            if (!rowHasBalls_[y]) {
+                continue; // an empty row stays empty after the horizontal pass
+            }
+            const double *row = &splats_[y * cells_];
+            double *out = &rowPass_[y * cells_];
+            for (int x = 0; x < cells_; ++x) {
+                if (row[x] == 0) {
+                    continue;
+                }
+                int from = std::max(0, x - radius);
+                int to = std::min(cells_ - 1, x + radius);
+                for (int target = from; target <= to; ++target) {
+                    out[target] += row[x] * taps_[std::abs(target - x)];
+                }
+            }
+        }
+        smoothed_.assign(splats_.size(), 0);
+        for (int y = 0; y < cells_; ++y) {
+            double *out = &smoothed_[y * cells_];
+            int from = std::max(0, y - radius);
+            int to = std::min(cells_ - 1, y + radius);
+            for (int source = from; source <= to; ++source) {
+                if (!rowHasBalls_[source]) {
+                    continue;
+                }
+                const double *row = &rowPass_[source * cells_];
+                double weight = taps_[std::abs(source - y)];
+                for (int x = 0; x < cells_; ++x) {
+                    out[x] += row[x] * weight;
+                }
+            }
+        }
+    }
+
+    void buildAreaTable() {
+        int stride = cells_ + 1;
+        areaTable_.assign(stride * stride, 0);
+        for (int y = 0; y < cells_; ++y) {
+            double rowSum = 0;
+            for (int x = 0; x < cells_; ++x) {
+                rowSum += counts_[y * cells_ + x];
+                areaTable_[(y + 1) * stride + x + 1] = areaTable_[y * stride + x + 1] + rowSum;
+            }
+        }
+    }
+
+public:
+    explicit DensityField(double sigma = 0)
+            : sigma_(sigma), minX_(0), minY_(0), cellSize_(1), inverseCellSize_(1), cells_(0),
+              built_(false), worldId_(0), ballsCount_(0) {
+    }
+
+    // Rebuilds the field unless it was built for the same state; returns whether it was rebuilt
+    bool update(const World &world) {
+        if (built_ && worldId_ == world.world_id && ballsCount_ == world.balls.size()) {
+            return false;
+        }
+        build(world);
+        return true;
+    }
+
+    void build(const World &world) {
+        built_ = true;
+        worldId_ = world.world_id;
+        ballsCount_ = world.balls.size();
+        counts_.clear();
+        smoothed_.clear();
+        areaTable_.assign(1, 0);
+        cells_ = 0;
+        if (world.balls.empty()) {
+            return;
+        }
+
+        double minX = world.balls[0].position_.x_, maxX = minX;
+        double minY = world.balls[0].position_.y_, maxY = minY;
+        for (const Ball &ball : world.balls) {
+            minX = std::min(minX, ball.position_.x_);
+            maxX = std::max(maxX, ball.position_.x_);
+            minY = std::min(minY, ball.position_.y_);
+            maxY = std::max(maxY, ball.position_.y_);
+        }
+        // Room for the kernel's tails, so that density() may return 0 outside the grid
+        double margin = KERNEL_RADIUS_SIGMAS * sigma_;
+        minX_ = minX - margin;
+        minY_ = minY - margin;
+        double extent = std::max(maxX - minX, maxY - minY) + 2 * margin;
+        double targetCell = sigma_ > 0 ? sigma_ / CELLS_PER_SIGMA : std::max(world.ball_radius, 1e-9);
+        cells_ = std::max(1, std::min<int>(MAX_CELLS_PER_SIDE, static_cast<int>(std::ceil(extent / targetCell))));
+        cellSize_ = std::max(extent / cells_, 1e-9);
+        inverseCellSize_ = 1 / cellSize_;
+
+        counts_.assign(cells_ * cells_, 0);
+        for (const Ball &ball : world.balls) {
+            int x = clampCell((ball.position_.x_ - minX_) * inverseCellSize_);
+            int y = clampCell((ball.position_.y_ - minY_) * inverseCellSize_);
+            counts_[y * cells_ + x] += 1;
+        }
+        buildAreaTable();
+
+        if (sigma_ > 0) {
+            int radius = static_cast<int>(std::ceil(KERNEL_RADIUS_SIGMAS * sigma_ * inverseCellSize_));
+            taps_.resize(radius + 1);
+            for (int offset = 0; offset <= radius; ++offset) {
+                double distance = offset * cellSize_;
+                taps_[offset] = std::exp(-distance * distance / (2 * sigma_ * sigma_));
+            }
+            splat(world);
+            blur();
+        }
+    }
+
+    // Approximately the sum over balls of exp(-d^2 / (2 sigma^2)), d the distance to point
+    double density(const Point &point) const {
+        if (smoothed_.empty()) {
+            return 0;
+        }
+        // Bilinear interpolation between the centres of the four surrounding cells
+        double fx = (point.x_ - minX_) * inverseCellSize_ - 0.5;
+        double fy = (point.y_ - minY_) * inverseCellSize_ - 0.5;
+        if (fx < -1 || fy < -1 || fx > cells_ || fy > cells_) {
+            return 0;
+        }
+        int x0 = static_cast<int>(std::floor(fx));
+        int y0 = static_cast<int>(std::floor(fy));
+        double tx = fx - x0;
+        double ty = fy - y0;
+        auto at = [this](int x, int y) {
+            return x < 0 || y < 0 || x >= cells_ || y >= cells_ ? 0.0 : smoothed_[y * cells_ + x];
+        };
+        return (at(x0, y0) * (1 - tx) + at(x0 + 1, y0) * tx) * (1 - ty) +
+               (at(x0, y0 + 1) * (1 - tx) + at(x0 + 1, y0 + 1) * tx) * ty;
+    }
+
+    // Balls in the cells covered by the box spanned by the two corners, corner cells included
+    double boxCount(const Point &first, const Point &second) const {
+        if (cells_ == 0) {
+            return 0;
+        }
+        int x0 = clampCell((std::min(first.x_, second.x_) - minX_) * inverseCellSize_);
+        int x1 = clampCell((std::max(first.x_, second.x_) - minX_) * inverseCellSize_) + 1;
+        int y0 = clampCell((std::min(first.y_, second.y_) - minY_) * inverseCellSize_);
+        int y1 = clampCell((std::max(first.y_, second.y_) - minY_) * inverseCellSize_) + 1;
+        int stride = cells_ + 1;
+        return areaTable_[y1 * stride + x1] - areaTable_[y0 * stride + x1] -
+               areaTable_[y1 * stride + x0] + areaTable_[y0 * stride + x0];
+    }
+
+    double sigma() const {
+        return sigma_;
+    }
+
+    double cellSize() const {
+        return cellSize_;
+    }
+};
+
+#endif
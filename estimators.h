@@ -0,0 +1,326 @@
+#ifndef ESTIMATORS_H
+#define ESTIMATORS_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+#include "density_field.h"
+#include "game_objects.h"
+#include "utils.h"
+
+// Compile-time estimator algebra: terms are combined with + and scaled with * into one expression
+// type, so scoring a coin is a single inlined computation instead of a chain of std::function calls.
+// Every expression is callable like an Estimator and knows bounds of its value:
+//     value >= distanceWeight() * dist(ball, coin) + restMin()
+// which tells NearestCoinStrategy how far its grid search has to look.
+template<typename Derived>
+class EstimatorExpression {
+public:
+    const Derived &self() const {
+        return static_cast<const Derived &>(*this);
+    }
+
+    // Called once per replan before any coin is scored
+    void prepare(const World & /* world */, const Ball & /* ball */) {
+    }
+};
+
+class DistanceTerm : public EstimatorExpression<DistanceTerm> {
+public:
+    double operator()(const World &, const Ball &ball, const Coin &coin) const {
+        return dist(ball.position_, coin.position_);
+    }
+
+    double distanceWeight() const {
+        return 1;
+    }
+
+    double restMin() const {
+        return 0;
+    }
+
+    double restMax() const {
+        return 0;
+    }
+};
+
+// Cosine of the turn from the ball's velocity towards the coin, as in createVelocityDistEstimator
+class VelocityTurnTerm : public EstimatorExpression<VelocityTurnTerm> {
+public:
+    double operator()(const World &, const Ball &ball, const Coin &coin) const {
+        Point ahead(ball.position_.x_ + ball.velocity_.v_x_, ball.position_.y_ + ball.velocity_.v_y_);
+        return rotateCos(ball.position_, ahead, coin.position_);
+    }
+
+    double distanceWeight() const {
+        return 0;
+    }
+
+    double restMin() const {
+        return -1;
+    }
+
+    double restMax() const {
+        return 1;
+    }
+};
+
+// Balls strictly inside the box spanned by the ball and the coin, as in createAreaDensityEstimator
+class AreaDensityTerm : public EstimatorExpression<AreaDensityTerm> {
+public:
+    double operator()(const World &world, const Ball &ball, const Coin &coin) const {
+        double count = 0;
+        for (const Ball &other : world.balls) {
+            if ((other.position_.x_ - ball.position_.x_) * (other.position_.x_ - coin.position_.x_) < 0 &&
+                (other.position_.y_ - ball.position_.y_) * (other.position_.y_ - coin.position_.y_) < 0) {
+                count += 1;
+            }
+        }
+        return count;
+    }
+
+    double distanceWeight() const {
+        return 0;
+    }
+
+    double restMin() const {
+        return 0;
+    }
+
+    double restMax() const {
+        return std::numeric_limits<double>::infinity();
+    }
+};
+
+// Sum of a non-negative kernel of the distances from the coin to every ball, as in createCoinDensityEstimator
+template<typename Kernel>
+class CoinDensityTerm : public EstimatorExpression<CoinDensityTerm<Kernel>> {
+private:
+    Kernel kernel_;
+
+public:
+    explicit CoinDensityTerm(Kernel kernel) : kernel_(kernel) { }
+
+    double operator()(const World &world, const Ball &, const Coin &coin) const {
+        double density = 0;
+        for (const Ball &other : world.balls) {
+            density += kernel_(dist(coin.position_, other.position_));
+        }
+        return density;
+    }
+
+    double distanceWeight() const {
+        return 0;
+    }
+
+    double restMin() const {
+        return 0;
+    }
+
+    double restMax() const {
+        return std::numeric_limits<double>::infinity();
+    }
+};
+
+// AreaDensityTerm counted in a DensityField: O(1) per coin, but at cell resolution, so balls in
+// the corner cells of the box count as inside
+class GridAreaDensityTerm : public EstimatorExpression<GridAreaDensityTerm> {
+private:
+    DensityField field_;
+
+public:
+    void prepare(const World &world, const Ball &) {
+        field_.update(world);
+    }
+
+    double operator()(const World &, const Ball &ball, const Coin &coin) const {
+        // The ball itself always lies in its corner cell
+        return std::max(0.0, field_.boxCount(ball.position_, coin.position_) - 1);
+    }
+
+    double distanceWeight() const {
+        return 0;
+    }
+
+    double restMin() const {
+        return 0;
+    }
+
+    double restMax() const {
+        return std::numeric_limits<double>::infinity();
+    }
+};
+
+// CoinDensityTerm with a Gaussian kernel, sampled from a smoothed DensityField in O(1) per coin
+class GridCoinDensityTerm : public EstimatorExpression<GridCoinDensityTerm> {
+private:
+    DensityField field_;
+
+public:
+    explicit GridCoinDensityTerm(double sigma) : field_(sigma) { }
+
+    void prepare(const World &world, const Ball &) {
+        field_.update(world);
+    }
+
+    double operator()(const World &, const Ball &, const Coin &coin) const {
+        return field_.density(coin.position_);
+    }
+
+    double distanceWeight() const {
+        return 0;
+    }
+
+    double restMin() const {
+        return 0;
+    }
+
+    double restMax() const {
+        return std::numeric_limits<double>::infinity();
+    }
+};
+
+// exp(-d^2 / (2 sigma^2)), a kernel for CoinDensityTerm
+class GaussianKernel {
+private:
+    double inverseTwoSigmaSquared_;
+
+public:
+    explicit GaussianKernel(double sigma) : inverseTwoSigmaSquared_(1 / (2 * sigma * sigma)) { }
+
+    double operator()(double distance) const {
+        return std::exp(-distance * distance * inverseTwoSigmaSquared_);
+    }
+};
+
+template<typename Left, typename Right>
+class SumExpression : public EstimatorExpression<SumExpression<Left, Right>> {
+private:
+    Left left_;
+    Right right_;
+
+public:
+    SumExpression(const Left &left, const Right &right) : left_(left), right_(right) { }
+
+    void prepare(const World &world, const Ball &ball) {
+        left_.prepare(world, ball);
+        right_.prepare(world, ball);
+    }
+
+    double operator()(const World &world, const Ball &ball, const Coin &coin) const {
+        return left_(world, ball, coin) + right_(world, ball, coin);
+    }
+
+    double distanceWeight() const {
+        return left_.distanceWeight() + right_.distanceWeight();
+    }
+
+    double restMin() const {
+        return left_.restMin() + right_.restMin();
+    }
+
+    double restMax() const {
+        return left_.restMax() + right_.restMax();
+    }
+};
+
+template<typename Inner>
+class ScaledExpression : public EstimatorExpression<ScaledExpression<Inner>> {
+private:
+    double weight_;
+    Inner inner_;
+
+public:
+    ScaledExpression(double weight, const Inner &inner) : weight_(weight), inner_(inner) { }
+
+    void prepare(const World &world, const Ball &ball) {
+        inner_.prepare(world, ball);
+    }
+
+    double operator()(const World &world, const Ball &ball, const Coin &coin) const {
+        return weight_ * inner_(world, ball, coin);
+    }
+
+    double distanceWeight() const {
+        return weight_ * inner_.distanceWeight();
+    }
+
+    double restMin() const {
+        if (weight_ == 0) {
+            return 0;
+        }
+        return weight_ > 0 ? weight_ * inner_.restMin() : weight_ * inner_.restMax();
+    }
+
+    double restMax() const {
+        if (weight_ == 0) {
+            return 0;
+        }
+        return weight_ > 0 ? weight_ * inner_.restMax() : weight_ * inner_.restMin();
+    }
+};
+
+template<typename Left, typename Right>
+SumExpression<Left, Right> operator+(const EstimatorExpression<Left> &left, const EstimatorExpression<Right> &right) {
+    return SumExpression<Left, Right>(left.self(), right.self());
+}
+
+template<typename Inner>
+ScaledExpression<Inner> operator*(double weight, const EstimatorExpression<Inner> &inner) {
+    return ScaledExpression<Inner>(weight, inner.self());
+}
+
+DistanceTerm distanceTerm() {
+    return DistanceTerm();
+}
+
+VelocityTurnTerm velocityTurnTerm() {
+    return VelocityTurnTerm();
+}
+
+AreaDensityTerm areaDensityTerm() {
+    return AreaDensityTerm();
+}
+
+GridAreaDensityTerm gridAreaDensityTerm() {
+    return GridAreaDensityTerm();
+}
+
+GridCoinDensityTerm gridCoinDensityTerm(double sigma) {
+    return GridCoinDensityTerm(sigma);
+}
+
+template<typename Kernel>
+CoinDensityTerm<Kernel> coinDensityTerm(Kernel kernel) {
+    return CoinDensityTerm<Kernel>(kernel);
+}
+
+// Slack for NearestCoinStrategy's grid search, infinity if the expression is not bounded by the distance
+template<typename Expression>
+double estimatorSlack(const EstimatorExpression<Expression> &expression) {
+    const Expression &self = expression.self();
+    if (self.distanceWeight() < 1 || !(self.restMin() > -std::numeric_limits<double>::infinity())) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return std::max(0.0, -self.restMin());
+}
+
+template<typename Scorer>
+struct IsEstimatorExpression : std::is_base_of<EstimatorExpression<Scorer>, Scorer> {
+};
+
+// Plain estimators such as std::function carry no per-replan state
+template<typename Scorer>
+typename std::enable_if<!IsEstimatorExpression<Scorer>::value>::type
+prepareEstimator(Scorer &, const World &, const Ball &) {
+}
+
+template<typename Scorer>
+typename std::enable_if<IsEstimatorExpression<Scorer>::value>::type
+prepareEstimator(Scorer &scorer, const World &world, const Ball &ball) {
+    scorer.prepare(world, ball);
+}
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef FRAME_BUFFER_H
+#define FRAME_BUFFER_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A complete frame body inside FrameReceiveBuffer. Stays valid until the next fill() of that buffer.
+struct FrameView {
+    const char *data;
+    size_t size;
+
+    FrameView() : data(nullptr), size(0) { }
+
+    FrameView(const char *data, size_t size) : data(data), size(size) { }
+
+    std::string str() const {
+        return std::string(data, size);
+    }
+};
+
+// Reassembles length-prefixed frames (native u_int32_t length, then body) from a stream socket.
+// Bytes are received straight into one growable buffer that is reused for the whole connection:
+// consumed frames are dropped by moving the unread tail to the front, so steady state does not allocate.
+class FrameReceiveBuffer {
+private:
+    enum : size_t {
+        HEADER_SIZE = sizeof(u_int32_t),
+        MIN_READ_SIZE = 4096
+    };
+
+    std::vector<char> buffer_;
+    size_t begin_;
+    size_t end_;
+
+    size_t buffered() const {
+        return end_ - begin_;
+    }
+
+    // Size of the frame at begin_ including its header, or 0 if the header is not complete yet
+    size_t pendingFrameSize() const {
+        if (buffered() < HEADER_SIZE) {
+            return 0;
+        }
+        u_int32_t length;
+        std::memcpy(&length, buffer_.data() + begin_, HEADER_SIZE);
+        return HEADER_SIZE + length;
+    }
+
+    void reserveForRead() {
+        if (begin_ == end_) {
+            begin_ = end_ = 0;
+        }
+        size_t needed = std::max<size_t>(pendingFrameSize(), buffered() + MIN_READ_SIZE);
+        if (buffer_.size() - begin_ >= needed && buffer_.size() - end_ >= MIN_READ_SIZE) {
+            return;
+        }
+        if (begin_ > 0) {
+            std::memmove(buffer_.data(), buffer_.data() + begin_, buffered());
+            end_ -= begin_;
+            begin_ = 0;
+        }
+        if (buffer_.size() < needed) {
+            buffer_.resize(std::max<size_t>(needed, 2 * buffer_.size()));
+        }
+    }
+
+public:
+    explicit FrameReceiveBuffer(size_t capacity = 1 << 16)
+            : buffer_(std::max<size_t>(capacity, MIN_READ_SIZE)), begin_(0), end_(0) { }
+
+    bool hasFrame() const {
+        size_t frame_size = pendingFrameSize();
+        return frame_size > 0 && buffered() >= frame_size;
+    }
+
+    // Hands out the next complete frame without copying it
+    bool popFrame(FrameView &frame) {
+        if (!hasFrame()) {
+            return false;
+        }
+        size_t frame_size = pendingFrameSize();
+        frame = FrameView(buffer_.data() + begin_ + HEADER_SIZE, frame_size - HEADER_SIZE);
+        begin_ += frame_size;
+        return true;
+    }
+
+    // Receives whatever the socket has into the buffer: returns recv's result.
+    // Invalidates previously popped frames.
+    ssize_t fill(int sock, int flags = 0) {
+        reserveForRead();
+        ssize_t reads = recv(sock, buffer_.data() + end_, buffer_.size() - end_, flags);
+        if (reads > 0) {
+            end_ += reads;
+        }
+        return reads;
+    }
+};
+
+// Sends the length header and the body with one gather write, without joining them first.
+// Blocks until everything is sent or the socket fails; returns the number of bytes sent.
+int SendFrame(int sock, const char *data, size_t size) {
+    u_int32_t message_length = size;
+    struct iovec parts[2];
+    parts[0].iov_base = &message_length;
+    parts[0].iov_len = sizeof(message_length);
+    parts[1].iov_base = const_cast<char *>(data);
+    parts[1].iov_len = size;
+
+    struct msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = parts;
+    message.msg_iovlen = 2;
+
+    int total_sent = 0;
+    while (message.msg_iovlen > 0) {
+        ssize_t sent = sendmsg(sock, &message, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            break;
+        }
+        total_sent += sent;
+        while (message.msg_iovlen > 0 && static_cast<size_t>(sent) >= message.msg_iov->iov_len) {
+            sent -= message.msg_iov->iov_len;
+            ++message.msg_iov;
+            --message.msg_iovlen;
+        }
+        if (message.msg_iovlen > 0) {
+            message.msg_iov->iov_base = static_cast<char *>(message.msg_iov->iov_base) + sent;
+            message.msg_iov->iov_len -= sent;
+        }
+    }
+    return total_sent;
+}
+
+// A whole frame, length header included, that several send queues may hold at once
+typedef std::shared_ptr<const std::string> SharedFrame;
+
+SharedFrame MakeSharedFrame(const char *data, size_t size) {
+    u_int32_t message_length = size;
+    std::shared_ptr<std::string> frame(new std::string(sizeof(message_length) + size, '\0'));
+    std::memcpy(&(*frame)[0], &message_length, sizeof(message_length));
+    std::memcpy(&(*frame)[sizeof(message_length)], data, size);
+    return frame;
+}
+
+// Frames waiting to go out on a non-blocking socket. flush() writes as much as the socket takes
+// with one gather write and remembers where it stopped, so a slow reader costs queue memory, never
+// a blocked sender. Frames pushed as droppable (states that a newer one supersedes) can be dropped
+// before they start going out.
+class FrameSendQueue {
+private:
+    enum {
+        MAX_WRITE_FRAMES = 16
+    };
+
+    struct Entry {
+        SharedFrame frame;
+        bool droppable;
+    };
+
+    std::deque<Entry> entries_;
+    size_t sentOfFront_; // bytes of the front frame already written
+    size_t droppable_;
+
+public:
+    FrameSendQueue() : sentOfFront_(0), droppable_(0) { }
+
+    void push(const SharedFrame &frame, bool droppable) {
+        entries_.push_back(Entry{frame, droppable});
+        droppable_ += droppable;
+    }
+
+    bool empty() const {
+        return entries_.empty();
+    }
+
+    // Droppable frames in the queue, including a partly written one
+    size_t droppable() const {
+        return droppable_;
+    }
+
+    // Removes the droppable frames that did not start going out; returns how many
+    size_t dropUnsent() {
+        size_t dropped = 0;
+        std::deque<Entry> kept;
+        for (size_t index = 0; index < entries_.size(); ++index) {
+            if (entries_[index].droppable && !(index == 0 && sentOfFront_ > 0)) {
+                ++dropped;
+            } else {
+                kept.push_back(entries_[index]);
+            }
+        }
+        entries_.swap(kept);
+        droppable_ -= dropped;
+        return dropped;
+    }
+
+    // Writes until the queue is empty or the socket would block; false on a socket error
+    bool flush(int sock) {
+        while (!entries_.empty()) {
+            struct iovec parts[MAX_WRITE_FRAMES];
+            size_t count = std::min<size_t>(entries_.size(), MAX_WRITE_FRAMES);
+            for (size_t index = 0; index < count; ++index) {
+                size_t skip = index == 0 ? sentOfFront_ : 0;
+                parts[index].iov_base = const_cast<char *>(entries_[index].frame->data()) + skip;
+                parts[index].iov_len = entries_[index].frame->size() - skip;
+            }
+            struct msghdr message;
+            std::memset(&message, 0, sizeof(message));
+            message.msg_iov = parts;
+            message.msg_iovlen = count;
+            ssize_t sent = sendmsg(sock, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            size_t written = sent;
+            while (!entries_.empty() && written >= entries_.front().frame->size() - sentOfFront_) {
+                written -= entries_.front().frame->size() - sentOfFront_;
+                droppable_ -= entries_.front().droppable;
+                entries_.pop_front();
+                sentOfFront_ = 0;
+            }
+            sentOfFront_ += written;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -1,7 +1,11 @@
 #ifndef GAME_OBJECTS_H
 #define GAME_OBJECTS_H
 
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <new>
 #include <vector>
 
 class Point {
@@ -120,6 +124,164 @@ public:
 
 };
 
+// Growable array of doubles on 32-byte aligned storage, so vector loads never split a cache line.
+// The storage is kept when the column shrinks, so columns refilled every tick stop allocating.
+class AlignedColumn {
+private:
+    enum {
+        ALIGNMENT = 32
+    };
+
+    double *data_;
+    size_t size_;
+    size_t capacity_;
+
+public:
+    AlignedColumn() : data_(nullptr), size_(0), capacity_(0) { }
+
+    AlignedColumn(const AlignedColumn &other) : data_(nullptr), size_(0), capacity_(0) {
+        *this = other;
+    }
+
+    AlignedColumn(AlignedColumn &&other) noexcept : data_(other.data_), size_(other.size_), capacity_(other.capacity_) {
+        other.data_ = nullptr;
+        other.size_ = other.capacity_ = 0;
+    }
+
+    AlignedColumn &operator=(const AlignedColumn &other) {
+        if (this != &other) {
+            resize(other.size_);
+            std::copy(other.data_, other.data_ + other.size_, data_);
+        }
+        return *this;
+    }
+
+    AlignedColumn &operator=(AlignedColumn &&other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    ~AlignedColumn() {
+        free(data_);
+    }
+
+    void swap(AlignedColumn &other) noexcept {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+    }
+
+    void reserve(size_t capacity) {
+        if (capacity <= capacity_) {
+            return;
+        }
+        capacity = std::max(capacity, 2 * capacity_);
+        void *data = nullptr;
+        if (posix_memalign(&data, ALIGNMENT, capacity * sizeof(double)) != 0) {
+            throw std::bad_alloc();
+        }
+        if (size_ > 0) {
+            std::memcpy(data, data_, size_ * sizeof(double));
+        }
+        free(data_);
+        data_ = static_cast<double *>(data);
+        capacity_ = capacity;
+    }
+
+    void resize(size_t size) {
+        reserve(size);
+        size_ = size;
+    }
+
+    void clear() {
+        size_ = 0;
+    }
+
+    void push_back(double value) {
+        if (size_ == capacity_) {
+            reserve(size_ + 1);
+        }
+        data_[size_++] = value;
+    }
+
+    void pop_back() {
+        --size_;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+
+    double *data() {
+        return data_;
+    }
+
+    const double *data() const {
+        return data_;
+    }
+
+    double &operator[](size_t index) {
+        return data_[index];
+    }
+
+    double operator[](size_t index) const {
+        return data_[index];
+    }
+};
+
+// Structure-of-arrays copy of a world's balls and coins for vectorized scans: element i of every
+// column belongs to balls[i] or coins[i]
+struct WorldColumns {
+    AlignedColumn ballXs;
+    AlignedColumn ballYs;
+    AlignedColumn ballVxs;
+    AlignedColumn ballVys;
+    AlignedColumn coinXs;
+    AlignedColumn coinYs;
+    AlignedColumn coinValues;
+
+    void clear() {
+        ballXs.clear();
+        ballYs.clear();
+        ballVxs.clear();
+        ballVys.clear();
+        coinXs.clear();
+        coinYs.clear();
+        coinValues.clear();
+    }
+
+    void addBall(const Ball &ball) {
+        ballXs.push_back(ball.position_.x_);
+        ballYs.push_back(ball.position_.y_);
+        ballVxs.push_back(ball.velocity_.v_x_);
+        ballVys.push_back(ball.velocity_.v_y_);
+    }
+
+    void addCoin(const Coin &coin) {
+        coinXs.push_back(coin.position_.x_);
+        coinYs.push_back(coin.position_.y_);
+        coinValues.push_back(coin.value_);
+    }
+
+    void clearBalls() {
+        ballXs.clear();
+        ballYs.clear();
+        ballVxs.clear();
+        ballVys.clear();
+    }
+
+    // Moves the last coin into index, as World does with swap-and-pop removal
+    void removeCoin(size_t index) {
+        size_t last = coinXs.size() - 1;
+        coinXs[index] = coinXs[last];
+        coinYs[index] = coinYs[last];
+        coinValues[index] = coinValues[last];
+        coinXs.pop_back();
+        coinYs.pop_back();
+        coinValues.pop_back();
+    }
+};
+
 class World {
 public:
     unsigned long long world_id; // id of state of the world
@@ -133,6 +295,29 @@ public:
     std::vector<Ball> balls;
     std::vector<Coin> coins;
 
+    // Filled by the parsers together with balls and coins; code that edits those directly
+    // has to call updateColumns() or clear columnsSynced before handing the world over
+    WorldColumns columns;
+    bool columnsSynced; // set by whoever keeps columns element for element equal to balls and coins
+
+    World() : columnsSynced(false) { }
+
+    void updateColumns() {
+        columns.clear();
+        for (const Ball &ball : balls) {
+            columns.addBall(ball);
+        }
+        for (const Coin &coin : coins) {
+            columns.addCoin(coin);
+        }
+        columnsSynced = true;
+    }
+
+    // Whether columns describe the world's balls and coins
+    bool hasColumns() const {
+        return columnsSynced && columns.ballXs.size() == balls.size() && columns.coinXs.size() == coins.size();
+    }
+
     template<typename Writer>
     void Serialize(Writer &writer) const {
         writer.String("state_id");
@@ -162,4 +347,19 @@ public:
     }
 };
 
+// The world's own columns if they are in sync with it, otherwise scratch filled from the world
+const WorldColumns &columnsOf(const World &world, WorldColumns &scratch) {
+    if (world.hasColumns()) {
+        return world.columns;
+    }
+    scratch.clear();
+    for (const Ball &ball : world.balls) {
+        scratch.addBall(ball);
+    }
+    for (const Coin &coin : world.coins) {
+        scratch.addCoin(coin);
+    }
+    return scratch;
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,553 @@
+#ifndef GAME_SERVER_H
+#define GAME_SERVER_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "binary_message_builder.h"
+#include "binary_message_parser.h"
+#include "frame_buffer.h"
+#include "game_simulation.h"
+#include "logger.h"
+#include "message_builder.h"
+#include "message_parser.h"
+
+struct ServerSettings {
+    size_t port;
+    size_t gamers;          // the game starts once this many gamers subscribed
+    size_t ticks;
+    long tickMs;            // tick length; 0 runs in lockstep, a tick ends once every gamer answered
+    long turnTimeoutMs;     // lockstep only: how long to wait for a slow gamer
+    int keyframeInterval;   // binary-delta streams: states between keyframes
+    bool jsonOnly;          // refuse the binary encodings whatever the gamers offer
+    SimulationSettings simulation;
+
+    ServerSettings() : port(0), gamers(1), ticks(1000), tickMs(0), turnTimeoutMs(1000), keyframeInterval(10),
+                       jsonOnly(false) { }
+};
+
+// Headless reference server for local runs: accepts gamers and viewers on the loopback interface,
+// broadcasts a STATE every tick in each connection's negotiated encoding, applies the TURNs that
+// answer it and sends FINISH after the last tick. Viewers may join at any time; gamers that join
+// after the start get a ball in the running game.
+//
+// Every state is serialized once per encoding into a shared frame that all connections queue, and
+// sockets are non-blocking and served from one epoll loop. A connection that falls behind by
+// MAX_QUEUED_STATES states has its unsent states dropped (delta streams restart from a keyframe),
+// so a slow viewer costs its own states, never the tick.
+class GameServer {
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    enum {
+        MAX_QUEUED_STATES = 2,
+        MAX_EVENTS = 64,
+        FINISH_FLUSH_MS = 1000
+    };
+
+    enum Encoding {
+        ENCODING_JSON,
+        ENCODING_BINARY,
+        ENCODING_DELTA
+    };
+
+    struct Connection {
+        int sock;
+        uint32_t events;    // registered with epoll
+        bool subscribed;
+        bool gamer;
+        size_t id;
+        size_t ballIndex;
+        Encoding encoding;
+        FrameReceiveBuffer receiveBuffer;
+        FrameSendQueue sendQueue;
+        bool needsKeyframe; // binary-delta: the next state must not depend on the previous ones
+        bool answered;      // a turn for the current state arrived
+        size_t turns;
+        size_t lateTurns;
+        size_t missedTurns;
+        size_t droppedStates;
+
+        Connection(int sock)
+                : sock(sock), events(0), subscribed(false), gamer(false), id(0), ballIndex(0),
+                  encoding(ENCODING_JSON), needsKeyframe(true), answered(true), turns(0), lateTurns(0),
+                  missedTurns(0), droppedStates(0) { }
+
+        ~Connection() {
+            if (sock >= 0) {
+                close(sock);
+            }
+        }
+    };
+
+    ServerSettings settings_;
+    GameSimulation simulation_;
+    int listenSock_;
+    int epoll_;
+    std::vector<std::unique_ptr<Connection>> connections_;
+    std::vector<std::unique_ptr<Connection>> departedGamers_;
+    size_t gamersCount_;
+    size_t nextId_;
+    rapidjson::StringBuffer jsonBuffer_;
+    std::string binaryBuffer_;
+    // Frames of the current state, built on first use
+    SharedFrame jsonFrame_;
+    SharedFrame binaryFrame_;
+    SharedFrame deltaFrame_;
+    SharedFrame keyframeFrame_;
+    unsigned long long previousWorldId_; // base of this tick's delta
+    size_t statesSent_;
+    double broadcastSeconds_;
+
+    void listenOnPort() {
+        listenSock_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (listenSock_ < 0) {
+            throw std::runtime_error("Error: failed to create socket");
+        }
+        int reuse = 1;
+        setsockopt(listenSock_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(settings_.port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(listenSock_, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(listenSock_, 64) < 0) {
+            throw std::runtime_error("Error: can not listen on port " + std::to_string(settings_.port));
+        }
+        epoll_ = epoll_create1(0);
+        if (epoll_ < 0) {
+            throw std::runtime_error("Error: failed to create epoll");
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr; // the listening socket
+        epoll_ctl(epoll_, EPOLL_CTL_ADD, listenSock_, &event);
+    }
+
+    // Keeps epoll watching for writability exactly while the connection has frames queued
+    void updateInterest(Connection &connection) {
+        uint32_t events = EPOLLIN | (connection.sendQueue.empty() ? 0u : static_cast<uint32_t>(EPOLLOUT));
+        if (events == connection.events) {
+            return;
+        }
+        struct epoll_event event;
+        event.events = events;
+        event.data.ptr = &connection;
+        epoll_ctl(epoll_, connection.events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, connection.sock, &event);
+        connection.events = events;
+    }
+
+    void acceptConnections() {
+        while (true) {
+            int sock = accept4(listenSock_, nullptr, nullptr, SOCK_NONBLOCK);
+            if (sock < 0) {
+                return;
+            }
+            int no_delay = 1;
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+            connections_.emplace_back(new Connection(sock));
+            updateInterest(*connections_.back());
+        }
+    }
+
+    // Queues the frame and writes what the socket takes right away; false if the connection failed
+    bool send(Connection &connection, const SharedFrame &frame, bool droppable) {
+        connection.sendQueue.push(frame, droppable);
+        if (!connection.sendQueue.flush(connection.sock)) {
+            return false;
+        }
+        updateInterest(connection);
+        return true;
+    }
+
+    bool sendString(Connection &connection, const std::string &message) {
+        return send(connection, MakeSharedFrame(message.data(), message.size()), false);
+    }
+
+    // Picks the richest encoding both sides speak
+    Encoding negotiate(const GamerSubscribeRequestMessage &request) const {
+        if (settings_.jsonOnly) {
+            return ENCODING_JSON;
+        }
+        const std::vector<std::string> &offered = request.capabilities;
+        if (std::find(offered.begin(), offered.end(), mBinaryDeltaEncoding) != offered.end()) {
+            return ENCODING_DELTA;
+        }
+        if (std::find(offered.begin(), offered.end(), mBinaryEncoding) != offered.end()) {
+            return ENCODING_BINARY;
+        }
+        return ENCODING_JSON;
+    }
+
+    // Handles the first frame of a connection; false if it is not a subscribe request
+    bool subscribe(Connection &connection, const FrameView &frame) {
+        std::unique_ptr<Message> message;
+        try {
+            message = MessageFromJson(frame.str());
+        } catch (const std::exception &) {
+            message.reset(new Message());
+        }
+
+        connection.id = nextId_++;
+        if (message->type == mGamerSubscribeRequestType) {
+            const GamerSubscribeRequestMessage &request = static_cast<const GamerSubscribeRequestMessage &>(*message);
+            connection.encoding = negotiate(request);
+            GamerSubscribeResultMessage result;
+            result.result = true;
+            result.player_id = connection.id;
+            if (connection.encoding == ENCODING_DELTA) {
+                result.encoding = mBinaryDeltaEncoding;
+            } else if (connection.encoding == ENCODING_BINARY) {
+                result.encoding = mBinaryEncoding;
+            }
+            if (!sendString(connection, BuildGamerSubscribeResultMessage(result))) {
+                return false;
+            }
+            connection.ballIndex = simulation_.addBall(connection.id);
+            connection.gamer = true;
+            ++gamersCount_;
+            LOG_INFO("Gamer %zu subscribed, encoding %s", connection.id,
+                     result.encoding.empty() ? "json" : result.encoding.c_str());
+        } else if (message->type == mViewerSubscribeRequestType) {
+            ViewerSubscribeResultMessage result;
+            result.result = true;
+            result.viewer_id = connection.id;
+            if (!sendString(connection, BuildViewerSubscribeResultMessage(result))) {
+                return false;
+            }
+            LOG_INFO("Viewer %zu subscribed", connection.id);
+        } else {
+            LOG_WARNING("Expected a subscribe request, closing the connection");
+            return false;
+        }
+        connection.subscribed = true; // its first state goes out with the next tick
+        return true;
+    }
+
+    void dropConnection(Connection &connection) {
+        if (connection.gamer) {
+            // The ball stays in the game and coasts
+            simulation_.setAcceleration(connection.ballIndex, Acceleration(0, 0));
+            --gamersCount_;
+        }
+        epoll_ctl(epoll_, EPOLL_CTL_DEL, connection.sock, nullptr);
+        close(connection.sock);
+        connection.sock = -1;
+    }
+
+    // Gamers that left are kept for the summary
+    void removeClosedConnections() {
+        auto closed = std::stable_partition(connections_.begin(), connections_.end(),
+                                            [](const std::unique_ptr<Connection> &connection) {
+                                                return connection->sock >= 0;
+                                            });
+        for (auto connection = closed; connection != connections_.end(); ++connection) {
+            if ((*connection)->gamer) {
+                departedGamers_.push_back(std::move(*connection));
+            }
+        }
+        connections_.erase(closed, connections_.end());
+    }
+
+    void applyTurn(Connection &connection, const FrameView &frame) {
+        if (!connection.gamer) {
+            return;
+        }
+        Turn turn;
+        if (IsBinaryMessage(frame.data, frame.size)) {
+            if (!TurnFromBinary(frame.data, frame.size, turn)) {
+                LOG_WARNING("Malformed binary turn from %zu", connection.id);
+                return;
+            }
+        } else {
+            std::unique_ptr<Message> message;
+            try {
+                message = MessageFromJson(frame.str());
+            } catch (const std::exception &) {
+                message.reset(new Message());
+            }
+            if (message->type != mTurnType) {
+                LOG_WARNING("Expected a turn from %zu", connection.id);
+                return;
+            }
+            turn = static_cast<const TurnMessage &>(*message).turn;
+        }
+        // An infinite or NaN acceleration would spread NaN through the whole simulation
+        if (!std::isfinite(turn.acceleration_.a_x_) || !std::isfinite(turn.acceleration_.a_y_)) {
+            LOG_WARNING("Malformed turn from %zu: non-finite acceleration", connection.id);
+            return;
+        }
+        if (turn.ball_id_ != connection.id) {
+            LOG_WARNING("Gamer %zu sent a turn for ball %zu", connection.id, turn.ball_id_);
+            return;
+        }
+        ++connection.turns;
+        if (turn.world_id_ != simulation_.world().world_id) {
+            ++connection.lateTurns;
+            return;
+        }
+        connection.answered = true;
+        simulation_.setAcceleration(connection.ballIndex, turn.acceleration_);
+    }
+
+    // Reads whatever the connection sent; false once it is closed or misbehaves
+    bool receive(Connection &connection) {
+        ssize_t reads = connection.receiveBuffer.fill(connection.sock, MSG_DONTWAIT);
+        if (reads == 0 || (reads < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            return false;
+        }
+        FrameView frame;
+        while (connection.receiveBuffer.popFrame(frame)) {
+            if (!connection.subscribed) {
+                if (!subscribe(connection, frame)) {
+                    return false;
+                }
+            } else {
+                applyTurn(connection, frame);
+            }
+        }
+        return true;
+    }
+
+    // Waits up to timeout_ms for socket events and handles them
+    void serveEvents(int timeout_ms) {
+        struct epoll_event events[MAX_EVENTS];
+        int ready = epoll_wait(epoll_, events, MAX_EVENTS, timeout_ms);
+        if (ready < 0 && errno != EINTR) {
+            LOG_ERROR("Error: epoll_wait failed");
+        }
+        for (int index = 0; index < ready; ++index) {
+            Connection *connection = static_cast<Connection *>(events[index].data.ptr);
+            if (!connection) {
+                acceptConnections();
+                continue;
+            }
+            if (connection->sock < 0) {
+                continue; // dropped earlier in this batch
+            }
+            bool alive = true;
+            if (events[index].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                alive = receive(*connection);
+            }
+            if (alive && (events[index].events & EPOLLOUT)) {
+                alive = connection->sendQueue.flush(connection->sock);
+                if (alive) {
+                    updateInterest(*connection);
+                }
+            }
+            if (!alive) {
+                LOG_INFO("%s %zu disconnected", connection->gamer ? "Gamer" : "Viewer", connection->id);
+                dropConnection(*connection);
+            }
+        }
+        removeClosedConnections();
+    }
+
+    void waitForGamers() {
+        LOG_INFO("Waiting for %zu gamers on port %zu", settings_.gamers, settings_.port);
+        while (gamersCount_ < settings_.gamers) {
+            serveEvents(-1);
+        }
+    }
+
+    SharedFrame buildStateFrame(Encoding encoding, bool keyframe) {
+        const World &world = simulation_.world();
+        const GameSimulation &simulation = simulation_;
+        auto coinId = [&simulation](size_t index) { return simulation.coinId(index); };
+        if (encoding == ENCODING_JSON) {
+            BuildWorldStateMessage(world, jsonBuffer_);
+            return MakeSharedFrame(jsonBuffer_.GetString(), jsonBuffer_.GetSize());
+        }
+        if (encoding == ENCODING_BINARY) {
+            BuildBinaryWorldStateMessage(world, binaryBuffer_);
+        } else if (keyframe) {
+            BuildBinaryKeyframeMessage(world, coinId, binaryBuffer_);
+        } else {
+            BuildBinaryDeltaMessage(world, previousWorldId_, coinId, simulation_.diff(), binaryBuffer_);
+        }
+        return MakeSharedFrame(binaryBuffer_.data(), binaryBuffer_.size());
+    }
+
+    // The frame of the current state for the connection, serialized only by the first connection that needs it
+    const SharedFrame &stateFrame(Connection &connection, bool keyframeDue) {
+        if (connection.encoding == ENCODING_JSON) {
+            if (!jsonFrame_) {
+                jsonFrame_ = buildStateFrame(ENCODING_JSON, false);
+            }
+            return jsonFrame_;
+        }
+        if (connection.encoding == ENCODING_BINARY) {
+            if (!binaryFrame_) {
+                binaryFrame_ = buildStateFrame(ENCODING_BINARY, false);
+            }
+            return binaryFrame_;
+        }
+        bool keyframe = keyframeDue || connection.needsKeyframe;
+        connection.needsKeyframe = false;
+        SharedFrame &frame = keyframe ? keyframeFrame_ : deltaFrame_;
+        if (!frame) {
+            frame = buildStateFrame(ENCODING_DELTA, keyframe);
+        }
+        return frame;
+    }
+
+    void broadcastState() {
+        Clock::time_point start = Clock::now();
+        jsonFrame_.reset();
+        binaryFrame_.reset();
+        deltaFrame_.reset();
+        keyframeFrame_.reset();
+        bool keyframeDue = statesSent_ % std::max(settings_.keyframeInterval, 1) == 0;
+        for (std::unique_ptr<Connection> &connection : connections_) {
+            if (!connection->subscribed) {
+                continue;
+            }
+            connection->answered = !connection->gamer;
+            // Backpressure: a connection that did not take the last states gets only the newest one
+            if (connection->sendQueue.droppable() >= MAX_QUEUED_STATES) {
+                connection->droppedStates += connection->sendQueue.dropUnsent();
+                connection->needsKeyframe = true;
+            }
+            if (!send(*connection, stateFrame(*connection, keyframeDue), true)) {
+                LOG_WARNING("Can not send state to %zu, closing the connection", connection->id);
+                dropConnection(*connection);
+            }
+        }
+        removeClosedConnections();
+        previousWorldId_ = simulation_.world().world_id;
+        ++statesSent_;
+        broadcastSeconds_ += std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    bool allAnswered() const {
+        for (const std::unique_ptr<Connection> &connection : connections_) {
+            if (connection->subscribed && !connection->answered) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Serves the connections until the tick is over: at its deadline, or in lockstep once every gamer answered
+    void collectTurns(Clock::time_point tick_start) {
+        bool lockstep = settings_.tickMs <= 0;
+        Clock::time_point deadline = tick_start +
+                std::chrono::milliseconds(lockstep ? settings_.turnTimeoutMs : settings_.tickMs);
+        // Read what the gamers sent even when broadcasting used up the whole tick
+        serveEvents(0);
+        while (!(lockstep && allAnswered())) {
+            Clock::time_point now = Clock::now();
+            if (now >= deadline) {
+                break;
+            }
+            long wait_us = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now).count();
+            serveEvents(static_cast<int>((wait_us + 999) / 1000));
+        }
+        for (const std::unique_ptr<Connection> &connection : connections_) {
+            if (connection->gamer && connection->subscribed && !connection->answered) {
+                ++connection->missedTurns;
+            }
+        }
+    }
+
+    bool sendQueuesEmpty() const {
+        for (const std::unique_ptr<Connection> &connection : connections_) {
+            if (!connection->sendQueue.empty()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Queues FINISH everywhere and gives slow connections a moment to take what is left
+    void finish() {
+        std::string message = BuildFinishMessage(FinishMessage());
+        SharedFrame frame = MakeSharedFrame(message.data(), message.size());
+        for (std::unique_ptr<Connection> &connection : connections_) {
+            if (connection->subscribed && !send(*connection, frame, false)) {
+                dropConnection(*connection);
+            }
+        }
+        removeClosedConnections();
+        Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(FINISH_FLUSH_MS);
+        while (!sendQueuesEmpty() && Clock::now() < deadline) {
+            serveEvents(10);
+        }
+    }
+
+    void printGamer(const Connection &connection) {
+        std::cout << "Gamer " << connection.id << ": turns " << connection.turns << ", late "
+                  << connection.lateTurns << ", missed " << connection.missedTurns << ", dropped "
+                  << connection.droppedStates << " states" << std::endl;
+    }
+
+    void printSummary(size_t ticks, double seconds) {
+        std::cout << "Ticks " << ticks << " in " << seconds << " s, " << (seconds > 0 ? ticks / seconds : 0)
+                  << " ticks/s" << std::endl;
+        std::cout << "Broadcast " << (ticks > 0 ? broadcastSeconds_ * 1e6 / ticks : 0) << " us per tick"
+                  << std::endl;
+        for (const Ball &ball : simulation_.world().balls) {
+            std::cout << "Ball " << ball.id_ << " score " << ball.score_ << std::endl;
+        }
+        for (const std::unique_ptr<Connection> &connection : departedGamers_) {
+            printGamer(*connection);
+        }
+        for (const std::unique_ptr<Connection> &connection : connections_) {
+            if (connection->gamer) {
+                printGamer(*connection);
+            } else if (connection->droppedStates > 0) {
+                std::cout << "Viewer " << connection->id << ": dropped " << connection->droppedStates << " states"
+                          << std::endl;
+            }
+        }
+    }
+
+public:
+    explicit GameServer(const ServerSettings &settings)
+            : settings_(settings), simulation_(settings.simulation), listenSock_(-1), epoll_(-1), gamersCount_(0),
+              nextId_(1), previousWorldId_(0), statesSent_(0), broadcastSeconds_(0) {
+    }
+
+    ~GameServer() {
+        connections_.clear();
+        if (epoll_ >= 0) {
+            close(epoll_);
+        }
+        if (listenSock_ >= 0) {
+            close(listenSock_);
+        }
+    }
+
+    void run() {
+        listenOnPort();
+        waitForGamers();
+        LOG_INFO("Game started");
+        Clock::time_point start = Clock::now();
+        size_t tick = 0;
+        for (; tick < settings_.ticks && gamersCount_ > 0; ++tick) {
+            Clock::time_point tick_start = Clock::now();
+            broadcastState();
+            collectTurns(tick_start);
+            simulation_.step();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        finish();
+        printSummary(tick, seconds);
+    }
+};
+
+#endif
@@ -0,0 +1,313 @@
+#ifndef GAME_SIMULATION_H
+#define GAME_SIMULATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "game_objects.h"
+#include "spatial_index.h"
+#include "world_tracker.h"
+
+struct SimulationSettings {
+    double fieldRadius;
+    double ballRadius;
+    double coinRadius;
+    double deltaTime;
+    double maxVelocity;
+    // Speed gained per second under a full (unit length) turn acceleration
+    double acceleration;
+    // Coins the field is refilled to after every tick
+    size_t coinsCount;
+    // New coins per tick at most, so eaten coins come back gradually
+    size_t spawnPerTick;
+    int maxCoinValue;
+    unsigned seed;
+    // Resolve ball contacts with a loop over all pairs instead of the ball hash; O(balls^2), only
+    // meant as the reference the hash is checked against
+    bool allPairsContacts;
+
+    SimulationSettings() : fieldRadius(100), ballRadius(1), coinRadius(0.5), deltaTime(0.1), maxVelocity(1),
+                           acceleration(1), coinsCount(50), spawnPerTick(5), maxCoinValue(3), seed(1),
+                           allPairsContacts(false) { }
+};
+
+// Authoritative game physics of the local server. Every tick a ball's velocity changes by its
+// turn's acceleration (clamped to unit length) and is capped at max_velocity, balls bounce off
+// each other and stay inside the round field, and a ball that touches a coin scores its value.
+// Coins keep stable ids; diff() lists what the last tick added and removed, for delta streams.
+//
+// Balls are integrated over the world's structure-of-arrays columns and written back to
+// world.balls once per tick. Ball contacts and coin pickups are found through spatial hashes:
+// the ball hash is updated in place as balls move, the coin hash as coins are eaten and spawned,
+// so a tick costs O(balls + changed coins) instead of O(balls * (balls + coins)).
+class GameSimulation {
+private:
+    SimulationSettings settings_;
+    std::mt19937 random_;
+    World world_;
+    AlignedColumn accelerationXs_; // per ball, clamped to unit length, kept until the next turn
+    AlignedColumn accelerationYs_;
+    std::vector<CoinId> coinIds_;  // id of world_.coins[i]
+    CoinId nextCoinId_;
+    WorldDiff diff_;
+    SpatialHash ballHash_;         // cells as large as the contact distance
+    SpatialHash coinHash_;         // cells as large as the pickup distance
+    std::vector<int> nearby_;
+
+    Point randomPoint(double margin) {
+        std::uniform_real_distribution<double> unit(0, 1);
+        double radius = std::max(settings_.fieldRadius - margin, 0.0) * std::sqrt(unit(random_));
+        double angle = 2 * M_PI * unit(random_);
+        return Point(radius * std::cos(angle), radius * std::sin(angle));
+    }
+
+    void spawnCoins(size_t limit) {
+        std::uniform_int_distribution<int> value(1, std::max(settings_.maxCoinValue, 1));
+        for (size_t spawned = 0; spawned < limit && world_.coins.size() < settings_.coinsCount; ++spawned) {
+            diff_.addedCoins.push_back(world_.coins.size());
+            world_.coins.emplace_back(randomPoint(settings_.coinRadius), value(random_));
+            world_.columns.addCoin(world_.coins.back());
+            coinHash_.insert(world_.coins.back().position_.x_, world_.coins.back().position_.y_);
+            coinIds_.push_back(nextCoinId_++);
+        }
+    }
+
+    void removeCoin(size_t index) {
+        diff_.removedCoins.push_back(coinIds_[index]);
+        world_.coins[index] = world_.coins.back();
+        world_.coins.pop_back();
+        world_.columns.removeCoin(index);
+        coinHash_.removeSwapLast(index);
+        coinIds_[index] = coinIds_.back();
+        coinIds_.pop_back();
+    }
+
+    // Branch-free over the columns, so the compiler can vectorize it
+    void move() {
+        WorldColumns &columns = world_.columns;
+        double *xs = columns.ballXs.data();
+        double *ys = columns.ballYs.data();
+        double *vxs = columns.ballVxs.data();
+        double *vys = columns.ballVys.data();
+        const double *axs = accelerationXs_.data();
+        const double *ays = accelerationYs_.data();
+        double gain = settings_.acceleration * settings_.deltaTime;
+        double maxVelocity = settings_.maxVelocity;
+        double deltaTime = settings_.deltaTime;
+        size_t count = columns.ballXs.size();
+        for (size_t index = 0; index < count; ++index) {
+            double vx = vxs[index] + axs[index] * gain;
+            double vy = vys[index] + ays[index] * gain;
+            double speed = std::sqrt(vx * vx + vy * vy);
+            double scale = speed > maxVelocity ? maxVelocity / speed : 1.0;
+            vx *= scale;
+            vy *= scale;
+            vxs[index] = vx;
+            vys[index] = vy;
+            xs[index] += vx * deltaTime;
+            ys[index] += vy * deltaTime;
+        }
+    }
+
+    // Pushes balls back inside the field and drops the outward part of their velocity
+    void keepInside() {
+        WorldColumns &columns = world_.columns;
+        double limit = settings_.fieldRadius - settings_.ballRadius;
+        for (size_t index = 0; index < columns.ballXs.size(); ++index) {
+            double x = columns.ballXs[index];
+            double y = columns.ballYs[index];
+            double distance = std::sqrt(x * x + y * y);
+            if (distance <= limit || distance == 0) {
+                continue;
+            }
+            double nx = x / distance;
+            double ny = y / distance;
+            columns.ballXs[index] = nx * limit;
+            columns.ballYs[index] = ny * limit;
+            double outward = columns.ballVxs[index] * nx + columns.ballVys[index] * ny;
+            if (outward > 0) {
+                columns.ballVxs[index] -= outward * nx;
+                columns.ballVys[index] -= outward * ny;
+            }
+        }
+    }
+
+    // Equal-mass elastic contact: separates overlapping balls and swaps their normal velocities.
+    // Keeps both balls' hash cells current; returns whether they touched.
+    bool collide(size_t first, size_t second) {
+        WorldColumns &columns = world_.columns;
+        double dx = columns.ballXs[second] - columns.ballXs[first];
+        double dy = columns.ballYs[second] - columns.ballYs[first];
+        double distance = std::sqrt(dx * dx + dy * dy);
+        double contact = 2 * settings_.ballRadius;
+        if (distance >= contact) {
+            return false;
+        }
+        double nx = 1, ny = 0;
+        if (distance > 0) {
+            nx = dx / distance;
+            ny = dy / distance;
+        }
+        double push = (contact - distance) / 2;
+        columns.ballXs[first] -= nx * push;
+        columns.ballYs[first] -= ny * push;
+        columns.ballXs[second] += nx * push;
+        columns.ballYs[second] += ny * push;
+        ballHash_.move(first, columns.ballXs[first], columns.ballYs[first]);
+        ballHash_.move(second, columns.ballXs[second], columns.ballYs[second]);
+        double approach = (columns.ballVxs[first] - columns.ballVxs[second]) * nx +
+                          (columns.ballVys[first] - columns.ballVys[second]) * ny;
+        if (approach > 0) {
+            columns.ballVxs[first] -= approach * nx;
+            columns.ballVys[first] -= approach * ny;
+            columns.ballVxs[second] += approach * nx;
+            columns.ballVys[second] += approach * ny;
+        }
+        return true;
+    }
+
+    // Pairs are resolved in the same order and with the same positions as a loop over all of them
+    // would: by first, then second ball. The hash follows every push, and once the first ball moves
+    // the balls after the last one it met are looked up again around its new position.
+    void collideBalls() {
+        WorldColumns &columns = world_.columns;
+        size_t count = columns.ballXs.size();
+        if (settings_.allPairsContacts) {
+            for (size_t first = 0; first < count; ++first) {
+                for (size_t second = first + 1; second < count; ++second) {
+                    collide(first, second);
+                }
+            }
+            return;
+        }
+        for (size_t index = 0; index < count; ++index) {
+            ballHash_.move(index, columns.ballXs[index], columns.ballYs[index]);
+        }
+        double contact = 2 * settings_.ballRadius;
+        for (size_t first = 0; first < count; ++first) {
+            size_t next = first + 1; // balls before next were already checked against first
+            bool moved = true;
+            while (moved) {
+                moved = false;
+                nearby_.clear();
+                ballHash_.forEachNear(columns.ballXs[first], columns.ballYs[first], contact,
+                                      [this, next](int second) {
+                                          if (static_cast<size_t>(second) >= next) {
+                                              nearby_.push_back(second);
+                                          }
+                                      });
+                std::sort(nearby_.begin(), nearby_.end());
+                for (int second : nearby_) {
+                    next = second + 1;
+                    if (collide(first, second)) {
+                        moved = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // Each ball in turn eats every coin it touches
+    void collectCoins() {
+        WorldColumns &columns = world_.columns;
+        double reach = settings_.ballRadius + settings_.coinRadius;
+        for (size_t index = 0; index < world_.balls.size(); ++index) {
+            double x = columns.ballXs[index];
+            double y = columns.ballYs[index];
+            nearby_.clear();
+            coinHash_.forEachNear(x, y, reach, [this, &columns, x, y, reach](int coin) {
+                double dx = columns.coinXs[coin] - x;
+                double dy = columns.coinYs[coin] - y;
+                if (dx * dx + dy * dy < reach * reach) {
+                    nearby_.push_back(coin);
+                }
+            });
+            // Swap-and-pop from the back, so the coins still to remove keep their indices
+            std::sort(nearby_.begin(), nearby_.end(), std::greater<int>());
+            for (int coin : nearby_) {
+                world_.balls[index].score_ += world_.coins[coin].value_;
+                removeCoin(coin);
+            }
+        }
+    }
+
+    void writeBackBalls() {
+        const WorldColumns &columns = world_.columns;
+        for (size_t index = 0; index < world_.balls.size(); ++index) {
+            Ball &ball = world_.balls[index];
+            ball.position_ = Point(columns.ballXs[index], columns.ballYs[index]);
+            ball.velocity_ = Velocity(columns.ballVxs[index], columns.ballVys[index]);
+        }
+    }
+
+public:
+    explicit GameSimulation(const SimulationSettings &settings)
+            : settings_(settings), random_(settings.seed), nextCoinId_(NO_COIN_ID + 1),
+              ballHash_(2 * settings.ballRadius, 64),
+              coinHash_(settings.ballRadius + settings.coinRadius, settings.coinsCount) {
+        world_.world_id = 0;
+        world_.field_radius = settings_.fieldRadius;
+        world_.ball_radius = settings_.ballRadius;
+        world_.coin_radius = settings_.coinRadius;
+        world_.delta_time = settings_.deltaTime;
+        world_.max_velocity = settings_.maxVelocity;
+        world_.columnsSynced = true; // coins and balls change through the columns; step() writes balls back
+        spawnCoins(settings_.coinsCount);
+    }
+
+    // Places a resting ball for a new player and returns its index
+    size_t addBall(size_t id) {
+        world_.balls.emplace_back(id, randomPoint(settings_.ballRadius), Velocity(0, 0), 0);
+        world_.columns.addBall(world_.balls.back());
+        ballHash_.insert(world_.balls.back().position_.x_, world_.balls.back().position_.y_);
+        accelerationXs_.push_back(0);
+        accelerationYs_.push_back(0);
+        return world_.balls.size() - 1;
+    }
+
+    void setAcceleration(size_t ballIndex, const Acceleration &acceleration) {
+        double ax = acceleration.a_x_;
+        double ay = acceleration.a_y_;
+        double length = std::sqrt(ax * ax + ay * ay);
+        if (length > 1) {
+            ax /= length;
+            ay /= length;
+        }
+        accelerationXs_[ballIndex] = ax;
+        accelerationYs_[ballIndex] = ay;
+    }
+
+    // Advances the world by one tick of delta_time
+    void step() {
+        diff_.clear();
+        move();
+        collideBalls();
+        keepInside();
+        collectCoins();
+        spawnCoins(settings_.spawnPerTick);
+        writeBackBalls();
+        for (size_t index = 0; index < world_.balls.size(); ++index) {
+            diff_.movedBalls.push_back(index);
+        }
+        ++world_.world_id;
+    }
+
+    const World &world() const {
+        return world_;
+    }
+
+    CoinId coinId(size_t index) const {
+        return coinIds_[index];
+    }
+
+    // Coins added and removed by the last step(); indices refer to the current world
+    const WorldDiff &diff() const {
+        return diff_;
+    }
+};
+
+#endif
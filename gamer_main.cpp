@@ -16,7 +16,8 @@ int main(int argc, char *argv[]) {
 
     Options options(argc, argv);
 
-    Gamer gamer = Gamer(ActionManager(options.GetGlobalStrategy(), options.GetMovementStrategy()));
+    Gamer gamer(ActionManager(options.GetGlobalStrategy(), options.GetMovementStrategy()),
+                options.GetGamerSettings());
     gamer.run(options.GetPort());
 
     return 0;
@@ -0,0 +1,123 @@
+#ifndef HELD_KARP_H
+#define HELD_KARP_H
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) && !defined(HELD_KARP_NO_SIMD)
+#include <emmintrin.h>
+#define HELD_KARP_SIMD 1
+#endif
+
+// Exact shortest open path from a start point through every one of k points (Held-Karp).
+// The table is flat: row mask holds the cost of visiting exactly the points of mask and
+// ending at each point, padded to an even stride so two predecessors are relaxed at once.
+class HeldKarpSolver {
+public:
+    enum {
+        MAX_POINTS = 16
+    };
+
+private:
+    int size_;
+    int stride_;
+    std::vector<double> distances_; // size_ rows of stride_, padding columns are 0
+    std::vector<double> table_;     // (1 << size_) rows of stride_, unreachable entries are infinity
+
+    // min over prev of row[prev] + distances[prev]
+    double relax(const double *row, const double *distances) const {
+#ifdef HELD_KARP_SIMD
+        __m128d best = _mm_set1_pd(std::numeric_limits<double>::infinity());
+        for (int prev = 0; prev < stride_; prev += 2) {
+            best = _mm_min_pd(best, _mm_add_pd(_mm_loadu_pd(row + prev), _mm_loadu_pd(distances + prev)));
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, best);
+        return std::min(lanes[0], lanes[1]);
+#else
+        double best = std::numeric_limits<double>::infinity();
+        for (int prev = 0; prev < stride_; ++prev) {
+            best = std::min(best, row[prev] + distances[prev]);
+        }
+        return best;
+#endif
+    }
+
+public:
+    HeldKarpSolver() : size_(0), stride_(0) { }
+
+    // Number of elementary relaxations for k points, to estimate the solving time
+    static double steps(int size) {
+        return static_cast<double>(1 << size) * size * size;
+    }
+
+    // startDistances[i] is the cost from the start to point i, distances[i * size + j] between points
+    // (symmetric). Writes the visiting order to path and returns its cost.
+    double solve(const std::vector<double> &startDistances, const std::vector<double> &distances,
+                 int size, std::vector<int> &path) {
+        path.clear();
+        if (size <= 0) {
+            return 0;
+        }
+        const double infinity = std::numeric_limits<double>::infinity();
+        size_ = size;
+        stride_ = (size + 1) & ~1;
+        distances_.assign(size_ * stride_, 0);
+        for (int from = 0; from < size_; ++from) {
+            std::copy(distances.begin() + from * size_, distances.begin() + (from + 1) * size_,
+                      distances_.begin() + from * stride_);
+        }
+        table_.assign(static_cast<size_t>(1 << size_) * stride_, infinity);
+        for (int point = 0; point < size_; ++point) {
+            table_[(1 << point) * stride_ + point] = startDistances[point];
+        }
+
+        int full = (1 << size_) - 1;
+        for (int mask = 1; mask <= full; ++mask) {
+            if ((mask & (mask - 1)) == 0) {
+                continue;
+            }
+            double *row = &table_[mask * stride_];
+            for (int last = 0; last < size_; ++last) {
+                if (mask & (1 << last)) {
+                    row[last] = relax(&table_[(mask ^ (1 << last)) * stride_], &distances_[last * stride_]);
+                }
+            }
+        }
+
+        int last = 0;
+        const double *row = &table_[full * stride_];
+        for (int point = 1; point < size_; ++point) {
+            if (row[point] < row[last]) {
+                last = point;
+            }
+        }
+        double cost = row[last];
+
+        // Walks back by finding a predecessor that reproduces each entry exactly
+        int mask = full;
+        path.push_back(last);
+        while (mask != (1 << last)) {
+            int previousMask = mask ^ (1 << last);
+            const double *previousRow = &table_[previousMask * stride_];
+            double value = table_[mask * stride_ + last];
+            int previous = -1;
+            for (int point = 0; point < size_ && previous < 0; ++point) {
+                if ((previousMask & (1 << point)) && previousRow[point] + distances_[last * stride_ + point] == value) {
+                    previous = point;
+                }
+            }
+            if (previous < 0) {
+                break;
+            }
+            mask = previousMask;
+            last = previous;
+            path.push_back(last);
+        }
+        std::reverse(path.begin(), path.end());
+        return cost;
+    }
+};
+
+#endif
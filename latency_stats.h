@@ -0,0 +1,155 @@
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+// Log-linear histogram of nanosecond latencies in the spirit of HdrHistogram:
+// values below 64 are exact, larger ones keep their top 6 bits (about 3% relative error).
+// Recording is a couple of relaxed atomic operations, so any thread may record concurrently.
+class LatencyHistogram {
+private:
+    enum {
+        SUB_BUCKET_BITS = 5,
+        SUB_BUCKETS = 1 << SUB_BUCKET_BITS,
+        BUCKETS = (65 - SUB_BUCKET_BITS) * SUB_BUCKETS
+    };
+
+    std::atomic<uint64_t> counts_[BUCKETS];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> max_;
+
+    static int highestBit(uint64_t value) {
+        return 63 - __builtin_clzll(value);
+    }
+
+    static size_t bucketIndex(uint64_t value) {
+        if (value < 2 * SUB_BUCKETS) {
+            return value;
+        }
+        int shift = highestBit(value) - SUB_BUCKET_BITS;
+        return shift * SUB_BUCKETS + (value >> shift);
+    }
+
+    // Highest value that falls into the bucket
+    static uint64_t bucketValue(size_t index) {
+        if (index < 2 * SUB_BUCKETS) {
+            return index;
+        }
+        int shift = index / SUB_BUCKETS - 1;
+        uint64_t top = index % SUB_BUCKETS + SUB_BUCKETS;
+        return ((top + 1) << shift) - 1;
+    }
+
+public:
+    LatencyHistogram() {
+        reset();
+    }
+
+    void record(uint64_t nanoseconds) {
+        counts_[bucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        uint64_t max = max_.load(std::memory_order_relaxed);
+        while (nanoseconds > max && !max_.compare_exchange_weak(max, nanoseconds, std::memory_order_relaxed)) { }
+    }
+
+    uint64_t count() const {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t max() const {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    // Value below which the given fraction of recorded latencies fall
+    uint64_t percentile(double fraction) const {
+        uint64_t total = count();
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(fraction * total + 0.5);
+        rank = std::max<uint64_t>(1, std::min(rank, total));
+        uint64_t seen = 0;
+        for (size_t index = 0; index < BUCKETS; ++index) {
+            seen += counts_[index].load(std::memory_order_relaxed);
+            if (seen >= rank) {
+                return std::min(bucketValue(index), max());
+            }
+        }
+        return max();
+    }
+
+    void reset() {
+        for (size_t index = 0; index < BUCKETS; ++index) {
+            counts_[index].store(0, std::memory_order_relaxed);
+        }
+        count_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+};
+
+enum TurnStage {
+    STAGE_RECV,
+    STAGE_PARSE,
+    STAGE_PLAN,
+    STAGE_SERIALIZE,
+    STAGE_SEND,
+    STAGE_TURN, // parse to end of send
+    STAGES_COUNT
+};
+
+class TurnLatencyStats {
+private:
+    LatencyHistogram histograms_[STAGES_COUNT];
+
+    static const char *stageName(int stage) {
+        static const char *names[STAGES_COUNT] = {"recv", "parse", "plan", "serialize", "send", "turn"};
+        return names[stage];
+    }
+
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    void record(TurnStage stage, Clock::time_point start, Clock::time_point finish) {
+        histograms_[stage].record(std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count());
+    }
+
+    // p50/p90/p99/max per stage in microseconds
+    void dump(std::ostream &out) const {
+        out << std::fixed << std::setprecision(1)
+            << "stage       count      p50_us      p90_us      p99_us      max_us" << "\n";
+        for (int stage = 0; stage < STAGES_COUNT; ++stage) {
+            const LatencyHistogram &histogram = histograms_[stage];
+            out << std::left << std::setw(10) << stageName(stage) << std::right
+                << std::setw(7) << histogram.count()
+                << std::setw(12) << histogram.percentile(0.5) / 1e3
+                << std::setw(12) << histogram.percentile(0.9) / 1e3
+                << std::setw(12) << histogram.percentile(0.99) / 1e3
+                << std::setw(12) << histogram.max() / 1e3 << "\n";
+        }
+        out.unsetf(std::ios::floatfield);
+        out << std::setprecision(6) << std::flush;
+    }
+};
+
+// Records the time from construction to destruction into one stage
+class StageTimer {
+private:
+    TurnLatencyStats &stats_;
+    TurnStage stage_;
+    TurnLatencyStats::Clock::time_point start_;
+
+public:
+    StageTimer(TurnLatencyStats &stats, TurnStage stage)
+            : stats_(stats), stage_(stage), start_(TurnLatencyStats::Clock::now()) { }
+
+    ~StageTimer() {
+        stats_.record(stage_, start_, TurnLatencyStats::Clock::now());
+    }
+};
+
+#endif
@@ -0,0 +1,11 @@
+#include "server_options.h"
+
+
+int main(int argc, char *argv[]) {
+    ServerOptions options(argc, argv);
+
+    GameServer server(options.GetServerSettings());
+    server.run();
+
+    return 0;
+}
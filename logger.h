@@ -0,0 +1,171 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spsc_queue.h"
+
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARNING 3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_NONE 5
+
+// Statements below this level are compiled out, e.g. -DLOG_COMPILE_LEVEL=LOG_LEVEL_INFO for release bots
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_TRACE
+#endif
+
+// Formats on the calling thread into that thread's own lock-free ring; a background thread
+// drains the rings to stderr. A full ring drops the record instead of blocking the caller.
+class Logger {
+private:
+    enum {
+        RECORD_TEXT_SIZE = 496,
+        RING_SIZE = 1024,
+        IDLE_SLEEP_US = 1000
+    };
+
+    struct Record {
+        int level;
+        long long micros;
+        char text[RECORD_TEXT_SIZE];
+    };
+
+    typedef SpscQueue<Record> Ring;
+
+    std::atomic<int> level_;
+    std::atomic<size_t> dropped_;
+    std::chrono::steady_clock::time_point start_;
+
+    std::mutex ringsMutex_;
+    std::vector<std::shared_ptr<Ring>> rings_;
+
+    std::atomic<bool> stop_;
+    std::thread writer_;
+
+    Logger() : level_(LOG_LEVEL_INFO), dropped_(0), start_(std::chrono::steady_clock::now()), stop_(false),
+               writer_(&Logger::drainInBackground, this) { }
+
+    static const char *levelName(int level) {
+        static const char *names[] = {"trace", "debug", "info", "warning", "error"};
+        return names[level];
+    }
+
+    Ring &threadRing() {
+        static thread_local Ring *ring = nullptr;
+        if (!ring) {
+            std::shared_ptr<Ring> created = std::make_shared<Ring>(RING_SIZE);
+            std::lock_guard<std::mutex> lock(ringsMutex_);
+            rings_.push_back(created);
+            ring = created.get();
+        }
+        return *ring;
+    }
+
+    bool drain() {
+        std::vector<std::shared_ptr<Ring>> rings;
+        {
+            std::lock_guard<std::mutex> lock(ringsMutex_);
+            rings = rings_;
+        }
+        bool written = false;
+        Record record;
+        for (const std::shared_ptr<Ring> &ring : rings) {
+            while (ring->tryPop(record)) {
+                std::fprintf(stderr, "%lld.%06lld [%s] %s\n", record.micros / 1000000, record.micros % 1000000,
+                             levelName(record.level), record.text);
+                written = true;
+            }
+        }
+        size_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            std::fprintf(stderr, "[warning] logger dropped %zu records\n", dropped);
+            written = true;
+        }
+        if (written) {
+            std::fflush(stderr);
+        }
+        return written;
+    }
+
+    void drainInBackground() {
+        while (!stop_.load(std::memory_order_acquire)) {
+            if (!drain()) {
+                std::this_thread::sleep_for(std::chrono::microseconds(IDLE_SLEEP_US));
+            }
+        }
+        drain();
+    }
+
+public:
+    ~Logger() {
+        stop_.store(true, std::memory_order_release);
+        writer_.join();
+    }
+
+    static Logger &instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    bool enabled(int level) const {
+        return level >= level_.load(std::memory_order_relaxed);
+    }
+
+    void setLevel(int level) {
+        level_.store(level, std::memory_order_relaxed);
+    }
+
+    // Accepts trace, debug, info, warning, error or none
+    bool setLevel(const std::string &name) {
+        static const char *names[] = {"trace", "debug", "info", "warning", "error", "none"};
+        for (int level = LOG_LEVEL_TRACE; level <= LOG_LEVEL_NONE; ++level) {
+            if (name == names[level]) {
+                setLevel(level);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Text longer than a record is truncated
+    void write(int level, const char *format, ...) __attribute__((format(printf, 3, 4))) {
+        Record record;
+        record.level = level;
+        record.micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start_).count();
+        va_list args;
+        va_start(args, format);
+        std::vsnprintf(record.text, RECORD_TEXT_SIZE, format, args);
+        va_end(args);
+        if (!threadRing().tryPush(std::move(record))) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+};
+
+#define LOG_AT(level, ...) \
+    do { \
+        if ((level) >= LOG_COMPILE_LEVEL && Logger::instance().enabled(level)) { \
+            Logger::instance().write((level), __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_TRACE(...) LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_AT(LOG_LEVEL_WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+#endif
@@ -15,6 +15,14 @@ std::string BuildGamerSubscribeRequestMessage(const GamerSubscribeRequestMessage
     writer.StartObject();
     writer.String("type");
     writer.String(message.type.c_str(), message.type.size());
+    if (!message.capabilities.empty()) {
+        writer.String("capabilities");
+        writer.StartArray();
+        for (const std::string &capability : message.capabilities) {
+            writer.String(capability.c_str(), capability.size());
+        }
+        writer.EndArray();
+    }
     writer.EndObject();
     return buffer.GetString();
 }
@@ -31,6 +39,10 @@ std::string BuildGamerSubscribeResultMessage(const GamerSubscribeResultMessage &
         writer.String("ok");
         writer.String("id");
         writer.Uint(message.player_id);
+        if (!message.encoding.empty()) {
+            writer.String("encoding");
+            writer.String(message.encoding.c_str(), message.encoding.size());
+        }
     } else {
         writer.String("result");
         writer.String("fail");
@@ -69,6 +81,17 @@ std::string BuildViewerSubscribeResultMessage(const ViewerSubscribeResultMessage
     return buffer.GetString();
 }
 
+// Writes into a caller-owned buffer, so a server can reuse its storage every tick
+void BuildWorldStateMessage(const World &world, rapidjson::StringBuffer &buffer) {
+    buffer.Clear();
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    writer.StartObject();
+    writer.String("type");
+    writer.String(mWorldStateType.c_str(), mWorldStateType.size());
+    world.Serialize(writer);
+    writer.EndObject();
+}
+
 // Made for testing
 std::string BuildWorldStateMessage(const WorldStateMessage &message) {
     rapidjson::StringBuffer buffer;
@@ -81,14 +104,20 @@ std::string BuildWorldStateMessage(const WorldStateMessage &message) {
     return buffer.GetString();
 }
 
-std::string BuildTurnMessage(const TurnMessage &message) {
-    rapidjson::StringBuffer buffer;
+// Writes into a caller-owned buffer, so the client can reuse its storage every tick
+void BuildTurnMessage(const TurnMessage &message, rapidjson::StringBuffer &buffer) {
+    buffer.Clear();
     rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
     writer.StartObject();
     writer.String("type");
     writer.String(message.type.c_str(), message.type.size());
     message.turn.Serialize(writer);
     writer.EndObject();
+}
+
+std::string BuildTurnMessage(const TurnMessage &message) {
+    rapidjson::StringBuffer buffer;
+    BuildTurnMessage(message, buffer);
     return buffer.GetString();
 }
 
@@ -8,7 +8,16 @@
 #include "rapidjson/stringbuffer.h"
 
 std::unique_ptr<Message> ParseGamerSubscribeRequestMessage(const rapidjson::Document &document) {
-    return std::unique_ptr<Message>(new GamerSubscribeRequestMessage());
+    GamerSubscribeRequestMessage *message = new GamerSubscribeRequestMessage();
+    if (document.HasMember("capabilities") && document["capabilities"].IsArray()) {
+        const rapidjson::Value &capabilities = document["capabilities"];
+        for (rapidjson::SizeType index = 0; index < capabilities.Size(); ++index) {
+            if (capabilities[index].IsString()) {
+                message->capabilities.push_back(capabilities[index].GetString());
+            }
+        }
+    }
+    return std::unique_ptr<Message>(message);
 }
 
 std::unique_ptr<Message> ParseGamerSubscribeResultMessage(const rapidjson::Document &document) {
@@ -17,6 +26,9 @@ std::unique_ptr<Message> ParseGamerSubscribeResultMessage(const rapidjson::Docum
     message->result = result == "ok";
     if (message->result) {
         message->player_id = document["id"].GetUint();
+        if (document.HasMember("encoding") && document["encoding"].IsString()) {
+            message->encoding = document["encoding"].GetString();
+        }
     }
     return std::unique_ptr<Message>(message);
 }
@@ -63,6 +75,7 @@ std::unique_ptr<Message> ParseWorldStateMessage(const rapidjson::Document &docum
             world.coins.push_back(coin);
         }
     }
+    world.updateColumns();
     message->world = world;
     return std::unique_ptr<Message>(message);
 }
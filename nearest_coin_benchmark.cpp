@@ -0,0 +1,273 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "strategy.h"
+
+// Compares a linear scan over all coins with the CoinGrid ring search used by NearestCoinStrategy,
+// then the scalar, SSE2 and AVX2 batched geometry kernels from utils.h, then a std::function
+// estimator chain with the same estimator written as an expression from estimators.h, and finally
+// the exact density estimators with their DensityField lookups on a crowded server.
+
+World buildWorld(size_t coins_count) {
+    World world;
+    world.world_id = 0;
+    world.field_radius = 1000;
+    world.ball_radius = 10;
+    world.coin_radius = 2;
+    world.delta_time = 0.1;
+    world.max_velocity = 5;
+    for (size_t i = 0; i < coins_count; ++i) {
+        double x = rand() % 20000 / 10.0 - 1000;
+        double y = rand() % 20000 / 10.0 - 1000;
+        world.coins.push_back(Coin(Point(x, y), 1));
+    }
+    world.balls.push_back(Ball(0, Point(rand() % 2000 - 1000, rand() % 2000 - 1000), Velocity(1, 2), 0));
+    world.updateColumns();
+    return world;
+}
+
+template<typename Scorer>
+int linearNearest(const World &world, const Ball &ball, const Scorer &estimator) {
+    double dst = std::numeric_limits<double>::max();
+    int pos = -1;
+    for (size_t i = 0; i < world.coins.size(); ++i) {
+        double value = estimator(world, ball, world.coins[i]);
+        if (value < dst) {
+            dst = value;
+            pos = static_cast<int>(i);
+        }
+    }
+    return pos;
+}
+
+template<typename Function>
+double measureMicroseconds(size_t iterations, Function function) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        function();
+    }
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(finish - start).count() / iterations;
+}
+
+// Runs every kernel set the CPU supports over the coins and checks that each output is bit for bit
+// the scalar kernel's, as utils.h promises
+bool benchmarkKernels(const World &world) {
+    std::vector<GeometryKernels> kernel_sets;
+    kernel_sets.push_back(GeometryKernels{"scalar", squaredDistancesScalar, distancesScalar, productsScalar,
+                                          rotateCosinesScalar});
+#ifdef GEOMETRY_KERNELS_X86
+    kernel_sets.push_back(GeometryKernels{"sse2", squaredDistancesSse2, distancesSse2, productsSse2,
+                                          rotateCosinesSse2});
+    if (__builtin_cpu_supports("avx2")) {
+        kernel_sets.push_back(GeometryKernels{"avx2", squaredDistancesAvx2, distancesAvx2, productsAvx2,
+                                              rotateCosinesAvx2});
+    }
+#endif
+    size_t count = world.coins.size();
+    const AlignedColumn &xs = world.columns.coinXs;
+    const AlignedColumn &ys = world.columns.coinYs;
+    const Ball &ball = world.balls[0];
+    Point ahead(ball.position_.x_ + ball.velocity_.v_x_, ball.position_.y_ + ball.velocity_.v_y_);
+    size_t iterations = std::max<size_t>(20, 200000000 / count / 10);
+
+    std::vector<double> expected_squared(count), expected_distances(count), expected_products(count),
+            expected_rotate_cos(count);
+    squaredDistancesScalar(ball.position_.x_, ball.position_.y_, xs.data(), ys.data(), count, expected_squared.data());
+    distancesScalar(ball.position_.x_, ball.position_.y_, xs.data(), ys.data(), count, expected_distances.data());
+    productsScalar(ball.position_.x_, ball.position_.y_, xs.data(), ys.data(), count, expected_products.data());
+    rotateCosinesScalar(ball.position_, ahead, xs.data(), ys.data(), count, expected_rotate_cos.data());
+
+    std::vector<double> out(count);
+    std::cout << "kernels\tsquared_us\tdistances_us\tproducts_us\trotate_cos_us" << std::endl;
+    for (const GeometryKernels &kernels : kernel_sets) {
+        bool agree = true;
+        double squared_us = measureMicroseconds(iterations, [&]() {
+            kernels.squaredDistances(ball.position_.x_, ball.position_.y_, xs.data(), ys.data(), count, out.data());
+        });
+        agree = out == expected_squared && agree;
+        double distances_us = measureMicroseconds(iterations, [&]() {
+            kernels.distances(ball.position_.x_, ball.position_.y_, xs.data(), ys.data(), count, out.data());
+        });
+        agree = out == expected_distances && agree;
+        double products_us = measureMicroseconds(iterations, [&]() {
+            kernels.products(ball.position_.x_, ball.position_.y_, xs.data(), ys.data(), count, out.data());
+        });
+        agree = out == expected_products && agree;
+        double rotate_cos_us = measureMicroseconds(iterations, [&]() {
+            kernels.rotateCosines(ball.position_, ahead, xs.data(), ys.data(), count, out.data());
+        });
+        agree = out == expected_rotate_cos && agree;
+        if (!agree) {
+            std::cerr << "Error: " << kernels.name << " kernels disagree with scalar ones" << std::endl;
+            return false;
+        }
+        std::cout << kernels.name << "\t" << squared_us << "\t" << distances_us << "\t" << products_us << "\t"
+                  << rotate_cos_us << std::endl;
+    }
+    return true;
+}
+
+// Scores every coin with the combo estimator, once through std::function and once as an expression
+bool benchmarkEstimators(const World &world) {
+    const Ball &ball = world.balls[0];
+    Estimator chained = createComboEstimator(createVelocityDistEstimator(3), createCoinDensityEstimator(100, GaussianKernel(50)));
+    auto expression = distanceTerm() + 3 * velocityTurnTerm() + 100 * coinDensityTerm(GaussianKernel(50));
+    size_t iterations = std::max<size_t>(20, 20000000 / world.coins.size() / 10);
+
+    int chained_result = 0;
+    int expression_result = 0;
+    double chained_us = measureMicroseconds(iterations, [&]() {
+        chained_result = linearNearest(world, ball, chained);
+    });
+    double expression_us = measureMicroseconds(iterations, [&]() {
+        expression_result = linearNearest(world, ball, expression);
+    });
+    if (chained_result != expression_result) {
+        std::cerr << "Error: expression and std::function estimators disagree" << std::endl;
+        return false;
+    }
+    std::cout << "coins\tfunction_us\texpression_us\tspeedup" << std::endl;
+    std::cout << world.coins.size() << "\t" << chained_us << "\t" << expression_us << "\t"
+              << chained_us / expression_us << std::endl;
+    return true;
+}
+
+// Balls within the box spanned by the two corners grown by margin on every side, border included
+size_t countInBox(const World &world, const Point &first, const Point &second, double margin) {
+    size_t count = 0;
+    for (const Ball &ball : world.balls) {
+        if (ball.position_.x_ >= std::min(first.x_, second.x_) - margin &&
+            ball.position_.x_ <= std::max(first.x_, second.x_) + margin &&
+            ball.position_.y_ >= std::min(first.y_, second.y_) - margin &&
+            ball.position_.y_ <= std::max(first.y_, second.y_) + margin) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+// Exact O(coins x balls) density scoring against the grid field, including its per-state rebuild.
+// The smoothed density has to be within 5% of the exact one, and a box count has to lie between
+// the balls strictly inside the box and the balls within a cell of it.
+bool benchmarkDensity(size_t coins_count, size_t balls_count) {
+    World world = buildWorld(coins_count);
+    for (size_t i = 1; i < balls_count; ++i) {
+        world.balls.push_back(Ball(i, Point(rand() % 2000 - 1000, rand() % 2000 - 1000), Velocity(0, 0), 0));
+    }
+    world.updateColumns();
+    const Ball &ball = world.balls[0];
+    const double sigma = 50;
+    Estimator exact_coin = createCoinDensityEstimator(1, GaussianKernel(sigma));
+    Estimator exact_area = createAreaDensityEstimator(1);
+    DensityField field(sigma);
+    size_t iterations = 5;
+
+    double exact_coin_us = measureMicroseconds(iterations, [&]() {
+        for (const Coin &coin : world.coins) {
+            exact_coin(world, ball, coin);
+        }
+    });
+    double exact_area_us = measureMicroseconds(iterations, [&]() {
+        for (const Coin &coin : world.coins) {
+            exact_area(world, ball, coin);
+        }
+    });
+    double build_us = measureMicroseconds(iterations, [&]() {
+        field.build(world);
+    });
+    double error = 0;
+    double grid_us = measureMicroseconds(iterations, [&]() {
+        error = 0;
+        for (const Coin &coin : world.coins) {
+            double exact = exact_coin(world, ball, coin);
+            error = std::max(error, std::fabs(field.density(coin.position_) - exact) / std::max(exact, 1.0));
+        }
+    });
+    // grid_us above also pays for the exact values, time the lookups alone
+    double sink = 0;
+    grid_us = measureMicroseconds(iterations, [&]() {
+        for (const Coin &coin : world.coins) {
+            sink += field.density(coin.position_) + field.boxCount(ball.position_, coin.position_);
+        }
+    });
+    if (sink < 0) {
+        std::cerr << "Error: negative density" << std::endl;
+        return false;
+    }
+    if (error > 0.05) {
+        std::cerr << "Error: grid density disagrees with the exact one" << std::endl;
+        return false;
+    }
+    for (const Coin &coin : world.coins) {
+        double count = field.boxCount(ball.position_, coin.position_);
+        // The exact estimator leaves out the ball itself, which the box count includes
+        if (count < exact_area(world, ball, coin) + 1 ||
+            count > countInBox(world, ball.position_, coin.position_, field.cellSize())) {
+            std::cerr << "Error: grid box count disagrees with the exact one" << std::endl;
+            return false;
+        }
+    }
+    std::cout << coins_count << "\t" << balls_count << "\t" << exact_coin_us << "\t" << exact_area_us << "\t"
+              << build_us << "\t" << grid_us << "\t" << (exact_coin_us + exact_area_us) / (build_us + grid_us)
+              << "\t" << error << std::endl;
+    return true;
+}
+
+int main() {
+    const size_t coins_counts[] = {1000, 10000, 100000};
+    const double velocity_coeff = 3;
+    Estimator estimator = createVelocityDistEstimator(velocity_coeff);
+
+    std::cout << "coins\tlinear_us\tbuild_us\tupdate_us\tquery_us\tspeedup_rebuilt\tspeedup_unchanged" << std::endl;
+    for (size_t coins_count : coins_counts) {
+        World world = buildWorld(coins_count);
+        const Ball &ball = world.balls[0];
+        size_t iterations = std::max<size_t>(20, 20000000 / coins_count / 10);
+
+        int linear_result = 0;
+        double linear_us = measureMicroseconds(iterations, [&]() {
+            linear_result = linearNearest(world, ball, estimator);
+        });
+
+        // A replan after coins changed rebuilds the grid, otherwise update() only checks the coins
+        CoinGrid grid;
+        double build_us = measureMicroseconds(iterations, [&]() {
+            grid.build(world);
+        });
+        double update_us = measureMicroseconds(iterations, [&]() {
+            grid.update(world);
+        });
+        int grid_result = 0;
+        double query_us = measureMicroseconds(iterations, [&]() {
+            grid_result = grid.nearest(ball.position_, velocity_coeff, [&](int i) {
+                return estimator(world, ball, world.coins[i]);
+            });
+        });
+        if (linear_result != grid_result) {
+            std::cerr << "Error: grid and linear scan disagree" << std::endl;
+            return 1;
+        }
+
+        std::cout << coins_count << "\t" << linear_us << "\t" << build_us << "\t" << update_us << "\t"
+                  << query_us << "\t" << linear_us / (build_us + query_us) << "\t"
+                  << linear_us / (update_us + query_us) << std::endl;
+    }
+    std::cout << std::endl;
+    if (!benchmarkKernels(buildWorld(coins_counts[2]))) {
+        return 1;
+    }
+    std::cout << std::endl;
+    if (!benchmarkEstimators(buildWorld(coins_counts[1]))) {
+        return 1;
+    }
+    std::cout << std::endl;
+    std::cout << "coins\tballs\texact_coin_us\texact_area_us\tfield_build_us\tfield_lookup_us\tspeedup\tmax_rel_error"
+              << std::endl;
+    if (!benchmarkDensity(1000, 100) || !benchmarkDensity(1000, 1000) || !benchmarkDensity(10000, 1000)) {
+        return 1;
+    }
+    return 0;
+}
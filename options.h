@@ -1,4 +1,5 @@
 #include "strategy.h"
+#include "strategy_loader.h"
 #include "client.h"
 
 class Options {
@@ -14,6 +15,8 @@ public:
         std::string mov_str;
         std::string count;
         std::string confidence = "1";
+        std::string threads = "1";
+        std::string estimator;
 
         int cur_param = 1;
 
@@ -35,6 +38,39 @@ public:
             } else if (cur_param_name == STRATEGY_CONFIDENCE) {
                 confidence = argv[cur_param + 1];
                 cur_param += 2;
+            } else if (cur_param_name == THREADS_PARAM_NAME) {
+                threads = argv[cur_param + 1];
+                cur_param += 2;
+            } else if (cur_param_name == ESTIMATOR_PARAM_NAME) {
+                estimator = argv[cur_param + 1];
+                cur_param += 2;
+            } else if (cur_param_name == COALESCE_STATES_PARAM_NAME) {
+                gamerSettings_.coalesceStates = true;
+                cur_param += 1;
+            } else if (cur_param_name == PIPELINE_PARAM_NAME) {
+                gamerSettings_.pipeline = true;
+                cur_param += 1;
+            } else if (cur_param_name == TURN_BUDGET_PARAM_NAME) {
+                gamerSettings_.turnBudgetUs = std::atol(argv[cur_param + 1]);
+                cur_param += 2;
+            } else if (cur_param_name == STATS_INTERVAL_PARAM_NAME) {
+                gamerSettings_.statsIntervalSec = std::atol(argv[cur_param + 1]);
+                cur_param += 2;
+            } else if (cur_param_name == IMPROVE_ROUTES_PARAM_NAME) {
+                gamerSettings_.improveRoutes = true;
+                cur_param += 1;
+            } else if (cur_param_name == BINARY_PROTOCOL_PARAM_NAME) {
+                gamerSettings_.binaryProtocol = true;
+                cur_param += 1;
+            } else if (cur_param_name == DELTA_STATES_PARAM_NAME) {
+                gamerSettings_.deltaStates = true;
+                cur_param += 1;
+            } else if (cur_param_name == LOG_LEVEL_PARAM_NAME) {
+                if (!Logger::instance().setLevel(argv[cur_param + 1])) {
+                    std::cerr << GetWrongParameterMessage(argv[0], LOG_LEVEL_PARAM_NAME);
+                    exit(0);
+                }
+                cur_param += 2;
             } else if (cur_param_name == HELP_MESSAGE_NAME) {
                 std::cerr << GetHelpMessage(argv[0]) << "\n";
                 exit(0);
@@ -49,10 +85,21 @@ public:
 
         if (str == NEAREST_COIN_STR) {
             // globalStrategy_ = std::make_shared<GlobalStrategy>(new NearestCoinStrategy(1));
-            globalStrategy_.reset(new NearestCoinStrategy(std::atoi(confidence.c_str())));
+            if (estimator.empty()) {
+                globalStrategy_.reset(new NearestCoinStrategy(std::atoi(confidence.c_str())));
+            } else {
+                globalStrategy_.reset(EstimatorRegistry::instance().create(estimator, std::atoi(confidence.c_str())));
+                if (!globalStrategy_) {
+                    std::cerr << GetWrongParameterMessage(argv[0], ESTIMATOR_PARAM_NAME);
+                    exit(0);
+                }
+            }
         } else if (str == K_NEAREST_COIN_STR) {
             // globalStrategy_ = std::make_shared<GlobalStrategy>(new KNearestCoinsStrategy(1, std::atoi(count.c_str())));
-            globalStrategy_.reset(new KNearestCoinsStrategy(std::atoi(confidence.c_str()), std::atoi(count.c_str())));
+            globalStrategy_.reset(new KNearestCoinsStrategy(std::atoi(confidence.c_str()), std::atoi(count.c_str()),
+                                                             std::atoi(threads.c_str())));
+        } else if (str == HELD_KARP_STR) {
+            globalStrategy_.reset(new HeldKarpStrategy(std::atoi(confidence.c_str()), std::atoi(count.c_str())));
         } else {
             std::cerr << GetWrongParameterMessage(argv[0], GLOBAL_STR_PARAM_NAME);
             exit(0);
@@ -85,16 +132,31 @@ public:
         return movementStrategy_;
     }
 
+    const GamerSettings &GetGamerSettings() const {
+        return gamerSettings_;
+    }
+
 private:
     const std::string PORT_PARAM_NAME         = "--port";
     const std::string GLOBAL_STR_PARAM_NAME   = "--global-strategy";
     const std::string MOVEMENT_STR_PARAM_NAME = "--movement-strategy";
     const std::string COINS_COUNT_PARAM_NAME  = "--coins-count";
     const std::string STRATEGY_CONFIDENCE  = "--global-update-time";
+    const std::string THREADS_PARAM_NAME      = "--threads";
+    const std::string ESTIMATOR_PARAM_NAME    = "--estimator";
+    const std::string COALESCE_STATES_PARAM_NAME = "--coalesce-states";
+    const std::string PIPELINE_PARAM_NAME     = "--pipeline";
+    const std::string TURN_BUDGET_PARAM_NAME  = "--turn-budget-us";
+    const std::string STATS_INTERVAL_PARAM_NAME = "--stats-interval-sec";
+    const std::string IMPROVE_ROUTES_PARAM_NAME = "--improve-routes";
+    const std::string BINARY_PROTOCOL_PARAM_NAME = "--binary-protocol";
+    const std::string DELTA_STATES_PARAM_NAME = "--delta-states";
+    const std::string LOG_LEVEL_PARAM_NAME    = "--log-level";
     const std::string HELP_MESSAGE_NAME       = "--help";
 
     const std::string NEAREST_COIN_STR        = "nearest-coins-strategy";
     const std::string K_NEAREST_COIN_STR      = "k-nearest-coins-strategy";
+    const std::string HELD_KARP_STR           = "held-karp-strategy";
 
     const std::string MOVE_STR_FIRST          = "first";
     const std::string MOVE_STR_SECOND         = "second";
@@ -123,15 +185,26 @@ private:
                                         MOVEMENT_STR_PARAM_NAME + " MOVEMENT-STRATEGY " +
                                         COINS_COUNT_PARAM_NAME + " COUNT" + "\n" +
                                         STRATEGY_CONFIDENCE + " COUNT" + "\n" +
-                                        "  " + GLOBAL_STR_PARAM_NAME + "   nearest-coins-strategy, k-nearest-coin-strategy" + "\n" +
-                                        "  " + COINS_COUNT_PARAM_NAME + "       parameter for k-nearest coin strategy" + "\n" +
-                                        "  " + MOVEMENT_STR_PARAM_NAME + " first, second or random";
+                                        "  " + GLOBAL_STR_PARAM_NAME + "   nearest-coins-strategy, k-nearest-coin-strategy, held-karp-strategy" + "\n" +
+                                        "  " + COINS_COUNT_PARAM_NAME + "       parameter for k-nearest coin strategy, at most 16 coins for held-karp" + "\n" +
+                                        "  " + MOVEMENT_STR_PARAM_NAME + " first, second or random" + "\n" +
+                                        "  " + THREADS_PARAM_NAME + "           threads for the k-nearest coin strategy route search (default 1)" + "\n" +
+                                        "  " + ESTIMATOR_PARAM_NAME + "         coin estimator for nearest-coins-strategy: " + EstimatorRegistry::instance().names() + "\n" +
+                                        "  " + COALESCE_STATES_PARAM_NAME + "   answer only the newest buffered state" + "\n" +
+                                        "  " + PIPELINE_PARAM_NAME + "          plan turns on a separate thread from network I/O" + "\n" +
+                                        "  " + TURN_BUDGET_PARAM_NAME + "    microseconds to plan a turn before sending a fallback turn" + "\n" +
+                                        "  " + STATS_INTERVAL_PARAM_NAME + " seconds between turn latency reports" + "\n" +
+                                        "  " + IMPROVE_ROUTES_PARAM_NAME + "    shorten the planned route with 2-opt and Or-opt while waiting for the next state" + "\n" +
+                                        "  " + BINARY_PROTOCOL_PARAM_NAME + "   offer the binary STATE and TURN encoding, JSON if the server refuses" + "\n" +
+                                        "  " + DELTA_STATES_PARAM_NAME + "      offer binary keyframes with delta states in between" + "\n" +
+                                        "  " + LOG_LEVEL_PARAM_NAME + "         trace, debug, info (default), warning, error or none";
         return help_message;
     }
 
 	int port_;
 	std::shared_ptr<GlobalStrategy> globalStrategy_;
 	std::shared_ptr<MovementStrategy> movementStrategy_;
+	GamerSettings gamerSettings_;
 };
 
 
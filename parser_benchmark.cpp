@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "message_builder.h"
+#include "message_parser.h"
+#include "binary_message_builder.h"
+#include "binary_message_parser.h"
+#include "world_state_parser.h"
+#include "world_tracker.h"
+
+// Compares the DOM parser (MessageFromJson) with the streaming one (WorldStateFromJson) on STATE frames,
+// then the JSON and binary encodings of the same STATE and TURN frames, then full binary STATEs
+// with the keyframe and delta stream on a field where a few coins change per tick, and finally
+// the WorldTracker the client runs on every world.
+
+WorldStateMessage buildStateMessage(size_t coins_count, size_t balls_count) {
+    WorldStateMessage message;
+    World &world = message.world;
+    world.world_id = 42;
+    world.field_radius = 1000;
+    world.ball_radius = 10;
+    world.coin_radius = 2;
+    world.delta_time = 0.1;
+    world.max_velocity = 5;
+    for (size_t i = 0; i < balls_count; ++i) {
+        world.balls.push_back(Ball(i, Point(rand() % 2000 - 1000.5, rand() % 2000 - 1000.5),
+                                   Velocity(rand() % 10 / 3.0, rand() % 10 / 7.0), rand() % 100));
+    }
+    for (size_t i = 0; i < coins_count; ++i) {
+        world.coins.push_back(Coin(Point(rand() % 2000 - 1000.25, rand() % 2000 - 1000.75), 1 + rand() % 5));
+    }
+    return message;
+}
+
+std::string buildStateFrame(size_t coins_count, size_t balls_count) {
+    return BuildWorldStateMessage(buildStateMessage(coins_count, balls_count));
+}
+
+template<typename ParseFunction>
+double measureMicroseconds(size_t iterations, ParseFunction parse) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i) {
+        parse();
+    }
+    auto finish = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(finish - start).count() / iterations;
+}
+
+bool close(double first, double second, double tolerance) {
+    return std::fabs(first - second) <= tolerance * std::max(1.0, std::fabs(first));
+}
+
+bool sameBalls(const World &first, const World &second, double tolerance) {
+    if (first.balls.size() != second.balls.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < first.balls.size(); ++i) {
+        const Ball &a = first.balls[i];
+        const Ball &b = second.balls[i];
+        if (a.id_ != b.id_ || !close(a.position_.x_, b.position_.x_, tolerance) ||
+            !close(a.position_.y_, b.position_.y_, tolerance) || !close(a.velocity_.v_x_, b.velocity_.v_x_, tolerance) ||
+            !close(a.velocity_.v_y_, b.velocity_.v_y_, tolerance) || !close(a.score_, b.score_, tolerance)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sameWorlds(const World &first, const World &second, double tolerance) {
+    if (first.world_id != second.world_id || first.coins.size() != second.coins.size() ||
+        !sameBalls(first, second, tolerance)) {
+        return false;
+    }
+    for (size_t i = 0; i < first.coins.size(); ++i) {
+        const Coin &a = first.coins[i];
+        const Coin &b = second.coins[i];
+        if (!close(a.position_.x_, b.position_.x_, tolerance) || !close(a.position_.y_, b.position_.y_, tolerance) ||
+            !close(a.value_, b.value_, tolerance)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool coinLess(const Coin &first, const Coin &second) {
+    if (first.position_.x_ != second.position_.x_) {
+        return first.position_.x_ < second.position_.x_;
+    }
+    if (first.position_.y_ != second.position_.y_) {
+        return first.position_.y_ < second.position_.y_;
+    }
+    return first.value_ < second.value_;
+}
+
+// Whether both lists hold the same coins, bit for bit, in any order
+bool sameCoinMultisets(std::vector<Coin> first, std::vector<Coin> second) {
+    if (first.size() != second.size()) {
+        return false;
+    }
+    std::sort(first.begin(), first.end(), coinLess);
+    std::sort(second.begin(), second.end(), coinLess);
+    for (size_t i = 0; i < first.size(); ++i) {
+        if (coinLess(first[i], second[i]) || coinLess(second[i], first[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Builds and parses every STATE size and a TURN in both encodings, checking that they decode to the same data
+bool compareEncodings(const size_t *coins_counts, size_t sizes, size_t balls_count) {
+    std::cout << "coins\tjson_bytes\tbinary_bytes\tjson_build_us\tbinary_build_us\tjson_parse_us\tbinary_parse_us"
+              << std::endl;
+    for (size_t size_index = 0; size_index < sizes; ++size_index) {
+        size_t coins_count = coins_counts[size_index];
+        WorldStateMessage message = buildStateMessage(coins_count, balls_count);
+        size_t iterations = std::max<size_t>(5, 2000000 / (coins_count + balls_count));
+
+        std::string json_frame;
+        double json_build_us = measureMicroseconds(iterations, [&]() {
+            json_frame = BuildWorldStateMessage(message);
+        });
+        std::string binary_frame;
+        double binary_build_us = measureMicroseconds(iterations, [&]() {
+            BuildBinaryWorldStateMessage(message.world, binary_frame);
+        });
+
+        World json_world;
+        World binary_world;
+        bool parsed = true;
+        double json_parse_us = measureMicroseconds(iterations, [&]() {
+            parsed = WorldStateFromJson(json_frame, json_world) && parsed;
+        });
+        double binary_parse_us = measureMicroseconds(iterations, [&]() {
+            parsed = WorldStateFromBinary(binary_frame, binary_world) && parsed;
+        });
+        // Binary copies the doubles' bits; rapidjson's default number parsing may be off in the last place
+        if (!parsed || !sameWorlds(binary_world, message.world, 0) || !sameWorlds(json_world, message.world, 1e-12)) {
+            std::cerr << "Error: encodings do not round-trip the world" << std::endl;
+            return false;
+        }
+
+        std::cout << coins_count << "\t" << json_frame.size() << "\t" << binary_frame.size() << "\t"
+                  << json_build_us << "\t" << binary_build_us << "\t" << json_parse_us << "\t"
+                  << binary_parse_us << std::endl;
+    }
+
+    TurnMessage turn_message;
+    turn_message.turn = Turn(42, 7, Acceleration(0.125, -1.0 / 3));
+    size_t iterations = 1000000;
+    rapidjson::StringBuffer json_turn;
+    std::string binary_turn;
+    double json_build_us = measureMicroseconds(iterations, [&]() {
+        BuildTurnMessage(turn_message, json_turn);
+    });
+    double binary_build_us = measureMicroseconds(iterations, [&]() {
+        BuildBinaryTurnMessage(turn_message, binary_turn);
+    });
+    Turn decoded(0, 0, Acceleration(0, 0));
+    bool turn_parsed = true;
+    double binary_parse_us = measureMicroseconds(iterations, [&]() {
+        turn_parsed = TurnFromBinary(binary_turn, decoded) && turn_parsed;
+    });
+    if (!turn_parsed || decoded.world_id_ != 42 || decoded.ball_id_ != 7 || decoded.acceleration_.a_y_ != -1.0 / 3) {
+        std::cerr << "Error: binary turn does not round-trip" << std::endl;
+        return false;
+    }
+    std::cout << std::endl << "turn\tjson_bytes\tbinary_bytes\tjson_build_us\tbinary_build_us\tbinary_parse_us"
+              << std::endl;
+    std::cout << "turn\t" << json_turn.GetSize() << "\t" << binary_turn.size() << "\t" << json_build_us << "\t"
+              << binary_build_us << "\t" << binary_parse_us << std::endl;
+    return true;
+}
+
+// Ticks of a world where balls move and a few coins are taken and spawned, sent as full STATEs
+// and as a delta stream. The stream is applied in place, as the serial client plans on it;
+// handing it to another thread costs a copy, reported separately. Every tick the decoded balls
+// must equal the world's and its coins must be the world's in some order.
+bool compareDeltaStream(size_t coins_count, size_t balls_count, size_t changes_per_tick) {
+    const int keyframe_interval = 100;
+    const size_t ticks = 200;
+    WorldStateMessage message = buildStateMessage(coins_count, balls_count);
+    World &world = message.world;
+    StateStreamEncoder encoder(keyframe_interval);
+    StateStreamDecoder decoder;
+    std::string full_frame, stream_frame;
+    World full_world, handed_world;
+    size_t full_bytes = 0, stream_bytes = 0;
+    double full_build_us = 0, stream_build_us = 0, full_parse_us = 0, stream_parse_us = 0, copy_us = 0;
+    for (size_t tick = 0; tick < ticks; ++tick) {
+        world.world_id = tick + 1;
+        for (Ball &ball : world.balls) {
+            ball.position_.x_ += 0.5;
+        }
+        for (size_t change = 0; change < changes_per_tick; ++change) {
+            world.coins[rand() % world.coins.size()] = Coin(Point(rand() % 2000 - 1000.5, rand() % 2000 - 1000.5),
+                                                            1 + rand() % 5);
+        }
+        full_build_us += measureMicroseconds(1, [&]() {
+            BuildBinaryWorldStateMessage(world, full_frame);
+        });
+        stream_build_us += measureMicroseconds(1, [&]() {
+            encoder.encode(world, stream_frame);
+        });
+        full_parse_us += measureMicroseconds(1, [&]() {
+            WorldStateFromBinary(full_frame, full_world);
+        });
+        StateStreamDecoder::Result result = StateStreamDecoder::MALFORMED;
+        stream_parse_us += measureMicroseconds(1, [&]() {
+            result = decoder.apply(stream_frame);
+        });
+        copy_us += measureMicroseconds(1, [&]() {
+            handed_world = decoder.world();
+        });
+        if (result != StateStreamDecoder::APPLIED || handed_world.world_id != world.world_id ||
+            !sameBalls(handed_world, world, 0) || !sameCoinMultisets(handed_world.coins, world.coins)) {
+            std::cerr << "Error: delta stream lost the world" << std::endl;
+            return false;
+        }
+        full_bytes += full_frame.size();
+        stream_bytes += stream_frame.size();
+    }
+    std::cout << coins_count << "\t" << changes_per_tick << "\t" << full_bytes / ticks << "\t"
+              << stream_bytes / ticks << "\t" << full_build_us / ticks << "\t" << stream_build_us / ticks << "\t"
+              << full_parse_us / ticks << "\t" << stream_parse_us / ticks << "\t" << copy_us / ticks << std::endl;
+    return true;
+}
+
+// Ticks where a few coins are replaced in place and a few are erased from the middle with new ones
+// appended, timing WorldTracker::update and checking the diff and the ids it keeps
+bool benchmarkTracker(size_t coins_count, size_t changes_per_tick) {
+    const size_t ticks = 200;
+    World world = buildStateMessage(coins_count, 10).world;
+    WorldTracker tracker;
+    tracker.update(world);
+    double replace_us = 0, erase_us = 0;
+    for (size_t tick = 0; tick < ticks; ++tick) {
+        bool erase = tick % 2 == 1;
+        for (size_t change = 0; change < changes_per_tick; ++change) {
+            Coin coin(Point(rand() % 2000 - 1000.5, rand() % 2000 - 1000.5), 1 + rand() % 5);
+            if (erase) {
+                // Never erases a coin appended in the same tick
+                world.coins.erase(world.coins.begin() + rand() % (world.coins.size() - changes_per_tick));
+                world.coins.push_back(coin);
+            } else {
+                world.coins[rand() % world.coins.size()] = coin;
+            }
+        }
+        const WorldDiff *diff = nullptr;
+        (erase ? erase_us : replace_us) += measureMicroseconds(1, [&]() {
+            diff = &tracker.update(world);
+        });
+        // Replacing may hit the same coin twice in one tick
+        if (diff->addedCoins.size() != diff->removedCoins.size() || diff->addedCoins.size() > changes_per_tick ||
+            (erase && diff->addedCoins.size() != changes_per_tick)) {
+            std::cerr << "Error: tracker diff does not match the changes" << std::endl;
+            return false;
+        }
+        for (size_t i = 0; i < world.coins.size(); ++i) {
+            if (tracker.coinIndex(tracker.coinId(i)) != static_cast<int>(i)) {
+                std::cerr << "Error: tracker lost the index of a coin" << std::endl;
+                return false;
+            }
+        }
+    }
+    std::cout << coins_count << "\t" << changes_per_tick << "\t" << replace_us / (ticks / 2) << "\t"
+              << erase_us / (ticks / 2) << std::endl;
+    return true;
+}
+
+int main() {
+    const size_t coins_counts[] = {10, 1000, 100000};
+    const size_t balls_count = 10;
+
+    std::cout << "coins\tbytes\tdom_us\tsax_us\tspeedup" << std::endl;
+    for (size_t coins_count : coins_counts) {
+        std::string frame = buildStateFrame(coins_count, balls_count);
+        size_t iterations = std::max<size_t>(5, 2000000 / (coins_count + balls_count));
+
+        size_t checksum = 0;
+        double dom_us = measureMicroseconds(iterations, [&]() {
+            std::unique_ptr<Message> message = MessageFromJson(frame);
+            checksum += static_cast<WorldStateMessage *>(message.get())->world.coins.size();
+        });
+        World world;
+        double sax_us = measureMicroseconds(iterations, [&]() {
+            WorldStateFromJson(frame, world);
+            checksum += world.coins.size();
+        });
+        if (checksum != 2 * iterations * coins_count) {
+            std::cerr << "Error: parsers disagree on coins count" << std::endl;
+            return 1;
+        }
+
+        std::cout << coins_count << "\t" << frame.size() << "\t" << dom_us << "\t" << sax_us << "\t"
+                  << dom_us / sax_us << std::endl;
+    }
+    std::cout << std::endl;
+    if (!compareEncodings(coins_counts, sizeof(coins_counts) / sizeof(coins_counts[0]), balls_count)) {
+        return 1;
+    }
+    std::cout << std::endl << "coins\tchanges\tfull_bytes\tstream_bytes\tfull_build_us\tstream_build_us"
+              << "\tfull_parse_us\tstream_apply_us\tcopy_us" << std::endl;
+    for (size_t coins_count : coins_counts) {
+        if (!compareDeltaStream(coins_count, balls_count, 10)) {
+            return 1;
+        }
+    }
+    std::cout << std::endl << "coins\tchanges\ttracker_replace_us\ttracker_erase_us" << std::endl;
+    for (size_t coins_count : coins_counts) {
+        if (!benchmarkTracker(coins_count, std::min<size_t>(10, coins_count / 2))) {
+            return 1;
+        }
+    }
+    return 0;
+}
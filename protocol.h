@@ -4,6 +4,7 @@
 #include <iostream>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "game_objects.h"
 
@@ -16,6 +17,37 @@ static const std::string mWorldStateType = "STATE";
 static const std::string mTurnType = "TURN";
 static const std::string mFinishType = "FINISH";
 
+// Capability a gamer offers in CLI_SUB_REQUEST and the encoding a server picks in CLI_SUB_RESULT.
+// Without it both sides speak JSON.
+static const std::string mBinaryEncoding = "binary";
+// Binary keyframes every few ticks and deltas against the previous state in between
+static const std::string mBinaryDeltaEncoding = "binary-delta";
+
+// Fixed-layout little-endian encoding of STATE and TURN, see binary_message_builder.h.
+// Every binary frame starts with an 8-byte header: marker, kind, version (u16), flags (u32).
+// The marker can not start a JSON text, so both encodings may share one connection.
+enum BinaryLayout {
+    BINARY_MARKER = 0xB7,
+    BINARY_VERSION = 1,
+    BINARY_HEADER_SIZE = 8,
+    BINARY_STATE_HEADER_SIZE = BINARY_HEADER_SIZE + 8 + 5 * 8 + 4 + 4, // ids, radii and counts
+    BINARY_BALL_SIZE = 4 + 5 * 8,                                        // id, x, y, v_x, v_y, score
+    BINARY_COIN_SIZE = 3 * 8,                                            // x, y, value
+    BINARY_TURN_SIZE = BINARY_HEADER_SIZE + 8 + 4 + 2 * 8,               // state_id, id, a_x, a_y
+    BINARY_COIN_ID_SIZE = 8,                                             // CoinId, u64
+    BINARY_KEYED_COIN_SIZE = BINARY_COIN_ID_SIZE + BINARY_COIN_SIZE,     // id, then as in STATE
+    BINARY_DELTA_HEADER_SIZE = BINARY_HEADER_SIZE + 8 + 8 + 3 * 4        // state ids and counts
+};
+
+// A KEYFRAME is laid out as a STATE whose coins carry stable ids. A DELTA holds the state id, the
+// id of the state it applies to, then every ball, the ids of removed coins and the added coins.
+enum BinaryMessageKind {
+    BINARY_STATE = 1,
+    BINARY_TURN = 2,
+    BINARY_KEYFRAME = 3,
+    BINARY_DELTA = 4
+};
+
 
 class Message {
 public:
@@ -28,6 +60,7 @@ class GamerSubscribeResultMessage : public Message {
 public:
     bool result;
     size_t player_id;
+    std::string encoding; // mBinaryEncoding if the server accepted it, empty for JSON
 
     GamerSubscribeResultMessage() {
         type = mGamerSubscribeResultType;
@@ -44,6 +77,8 @@ class GamerSubscribeRequestMessage : public Message {
 public:
     typedef GamerSubscribeResultMessage ResultMessage;
 
+    std::vector<std::string> capabilities; // encodings the gamer can speak besides JSON
+
     GamerSubscribeRequestMessage() {
         type = mGamerSubscribeRequestType;
     }
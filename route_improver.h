@@ -0,0 +1,213 @@
+#ifndef ROUTE_IMPROVER_H
+#define ROUTE_IMPROVER_H
+
+#include <algorithm>
+#include <vector>
+
+#include "game_objects.h"
+#include "utils.h"
+
+// Local search over an open route from a fixed start: 2-opt reverses a stretch of the route and
+// Or-opt moves a stretch of up to three points elsewhere. Every move is priced in O(1) from the
+// edges it replaces, and only moves that join a point to one of its nearest neighbours are tried.
+// Only improving moves are applied, so the current route is always the best one found so far.
+class RouteImprover {
+private:
+    enum {
+        NEIGHBOURS = 8,
+        MAX_SEGMENT = 3,
+        CHECK_STOP_EVERY = 16
+    };
+
+    std::vector<Point> points_;     // points_[0] is the start, then the route's points
+    std::vector<int> route_;        // point at each route position, route_[0] == 0
+    std::vector<int> positionOf_;   // inverse of route_
+    std::vector<int> neighbours_;   // NEIGHBOURS closest points of every point, nearest first
+    std::vector<int> candidates_;
+    std::vector<double> xs_;        // points_ as separate coordinates for the batched kernels
+    std::vector<double> ys_;
+    std::vector<double> squaredDistances_;
+    int neighboursCount_;
+    double cost_;
+
+    double edge(int fromPosition, int toPosition) const {
+        if (toPosition >= static_cast<int>(route_.size())) {
+            return 0; // the route is open, nothing follows its last point
+        }
+        return dist(points_[route_[fromPosition]], points_[route_[toPosition]]);
+    }
+
+    double pointEdge(int fromPoint, int toPosition) const {
+        if (toPosition >= static_cast<int>(route_.size())) {
+            return 0;
+        }
+        return dist(points_[fromPoint], points_[route_[toPosition]]);
+    }
+
+    void updatePositions(int from, int to) {
+        for (int position = from; position < to; ++position) {
+            positionOf_[route_[position]] = position;
+        }
+    }
+
+    void buildNeighbours() {
+        int size = points_.size();
+        neighboursCount_ = std::min<int>(NEIGHBOURS, size - 1);
+        neighbours_.resize(size * neighboursCount_);
+        xs_.resize(size);
+        ys_.resize(size);
+        for (int point = 0; point < size; ++point) {
+            xs_[point] = points_[point].x_;
+            ys_[point] = points_[point].y_;
+        }
+        squaredDistances_.resize(size);
+        for (int point = 0; point < size; ++point) {
+            geometryKernels().squaredDistances(xs_[point], ys_[point], xs_.data(), ys_.data(), size,
+                                               squaredDistances_.data());
+            candidates_.clear();
+            for (int other = 0; other < size; ++other) {
+                if (other != point) {
+                    candidates_.push_back(other);
+                }
+            }
+            auto closer = [this](int first, int second) {
+                return squaredDistances_[first] < squaredDistances_[second] ||
+                       (squaredDistances_[first] == squaredDistances_[second] && first < second);
+            };
+            std::partial_sort(candidates_.begin(), candidates_.begin() + neighboursCount_, candidates_.end(), closer);
+            std::copy(candidates_.begin(), candidates_.begin() + neighboursCount_,
+                      neighbours_.begin() + point * neighboursCount_);
+        }
+    }
+
+    // Reverses route_[from..to] if joining from - 1 with to and from with to + 1 is shorter
+    bool tryTwoOpt(int from, int to) {
+        if (to <= from) {
+            return false;
+        }
+        double delta = edge(from - 1, to) + edge(from, to + 1) - edge(from - 1, from) - edge(to, to + 1);
+        if (delta > -1e-9) {
+            return false;
+        }
+        std::reverse(route_.begin() + from, route_.begin() + to + 1);
+        updatePositions(from, to + 1);
+        cost_ += delta;
+        return true;
+    }
+
+    // Moves route_[from..from + length) between positions after and after + 1, reversed if that is shorter
+    bool tryOrOpt(int from, int length, int after) {
+        int last = from + length - 1;
+        if (after >= from - 1 && after <= last) {
+            return false;
+        }
+        double removal = edge(from - 1, from) + edge(last, last + 1) - edge(from - 1, last + 1);
+        double gap = edge(after, after + 1);
+        double forward = edge(after, from) + pointEdge(route_[last], after + 1) - gap;
+        double backward = edge(after, last) + pointEdge(route_[from], after + 1) - gap;
+        double delta = std::min(forward, backward) - removal;
+        if (delta > -1e-9) {
+            return false;
+        }
+        bool reversed = backward < forward;
+        if (after < from) {
+            std::rotate(route_.begin() + after + 1, route_.begin() + from, route_.begin() + last + 1);
+            if (reversed) {
+                std::reverse(route_.begin() + after + 1, route_.begin() + after + 1 + length);
+            }
+            updatePositions(after + 1, last + 1);
+        } else {
+            std::rotate(route_.begin() + from, route_.begin() + last + 1, route_.begin() + after + 1);
+            if (reversed) {
+                std::reverse(route_.begin() + after + 1 - length, route_.begin() + after + 1);
+            }
+            updatePositions(from, after + 1);
+        }
+        cost_ += delta;
+        return true;
+    }
+
+    // Tries the moves that join the route at the given position (at least 1) to a near neighbour
+    bool improveAt(int position) {
+        int size = route_.size();
+        const int *previousNeighbours = &neighbours_[route_[position - 1] * neighboursCount_];
+        const int *neighbours = &neighbours_[route_[position] * neighboursCount_];
+        for (int index = 0; index < neighboursCount_; ++index) {
+            // 2-opt: a new edge from the point before position to its neighbour, on either side
+            int neighbourPosition = positionOf_[previousNeighbours[index]];
+            if (neighbourPosition > position && tryTwoOpt(position, neighbourPosition)) {
+                return true;
+            }
+            if (neighbourPosition < position - 1 && tryTwoOpt(neighbourPosition + 1, position - 1)) {
+                return true;
+            }
+            // Or-opt: the stretch starting at position goes right after the neighbour of its first point
+            neighbourPosition = positionOf_[neighbours[index]];
+            for (int length = 1; length <= MAX_SEGMENT && position + length <= size; ++length) {
+                if (tryOrOpt(position, length, neighbourPosition)) {
+                    return true;
+                }
+            }
+        }
+        // Reversing the whole tail only changes the edge into it
+        return tryTwoOpt(position, size - 1);
+    }
+
+public:
+    RouteImprover() : neighboursCount_(0), cost_(0) { }
+
+    void reset(const Point &start, const std::vector<Point> &route) {
+        points_.assign(1, start);
+        points_.insert(points_.end(), route.begin(), route.end());
+        int size = points_.size();
+        route_.resize(size);
+        positionOf_.resize(size);
+        cost_ = 0;
+        for (int position = 0; position < size; ++position) {
+            route_[position] = position;
+            positionOf_[position] = position;
+            if (position > 0) {
+                cost_ += edge(position - 1, position);
+            }
+        }
+        buildNeighbours();
+    }
+
+    // Applies improving moves until none is left or stop() returns true; returns whether the route changed
+    template<typename Stop>
+    bool improve(Stop stop) {
+        int size = route_.size();
+        if (size < 3) {
+            return false;
+        }
+        bool changed = false;
+        bool improved = true;
+        int checks = 0;
+        while (improved) {
+            improved = false;
+            for (int position = 1; position < size; ++position) {
+                if (++checks % CHECK_STOP_EVERY == 0 && stop()) {
+                    return changed;
+                }
+                while (improveAt(position)) {
+                    improved = changed = true;
+                }
+            }
+        }
+        return changed;
+    }
+
+    double cost() const {
+        return cost_;
+    }
+
+    // Indices into the reset route in their improved order
+    void order(std::vector<int> &result) const {
+        result.clear();
+        for (size_t position = 1; position < route_.size(); ++position) {
+            result.push_back(route_[position] - 1);
+        }
+    }
+};
+
+#endif
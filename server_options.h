@@ -0,0 +1,125 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "game_server.h"
+#include "logger.h"
+
+#pragma once
+
+class ServerOptions {
+public:
+    explicit ServerOptions(int argc, char* argv[]) {
+        if (argc < 3) {
+            std::cerr << GetUsageMessage(std::string(argv[0]));
+            exit(0);
+        }
+
+        int cur_param = 1;
+
+        while (cur_param < argc) {
+            std::string cur_param_name = std::string(argv[cur_param]);
+            bool has_value = cur_param + 1 < argc;
+
+            if (cur_param_name == PORT_PARAM_NAME && has_value) {
+                settings_.port = std::atoi(argv[cur_param + 1]);
+                cur_param += 2;
+            } else if (cur_param_name == GAMERS_PARAM_NAME && has_value) {
+                settings_.gamers = std::atoi(argv[cur_param + 1]);
+                cur_param += 2;
+            } else if (cur_param_name == TICKS_PARAM_NAME && has_value) {
+                settings_.ticks = std::atol(argv[cur_param + 1]);
+                cur_param += 2;
+            } else if (cur_param_name == TICK_MS_PARAM_NAME && has_value) {
+                settings_.tickMs = std::atol(argv[cur_param + 1]);
+                cur_param += 2;
+            } else if (cur_param_name == TURN_TIMEOUT_PARAM_NAME && has_value) {
+                settings_.turnTimeoutMs = std::atol(argv[cur_param + 1]);
+                cur_param += 2;
+            } else if (cur_param_name == KEYFRAME_INTERVAL_PARAM_NAME && has_value) {
+                settings_.keyframeInterval = std::atoi(argv[cur_param + 1]);
+                cur_param += 2;
+            } else if (cur_param_name == JSON_ONLY_PARAM_NAME) {
+                settings_.jsonOnly = true;
+                cur_param += 1;
+            } else if (cur_param_name == COINS_PARAM_NAME && has_value) {
+                settings_.simulation.coinsCount = std::atol(argv[cur_param + 1]);
+                settings_.simulation.spawnPerTick = std::max<size_t>(settings_.simulation.spawnPerTick,
+                                                                     settings_.simulation.coinsCount / 10);
+                cur_param += 2;
+            } else if (cur_param_name == FIELD_RADIUS_PARAM_NAME && has_value) {
+                settings_.simulation.fieldRadius = std::atof(argv[cur_param + 1]);
+                cur_param += 2;
+            } else if (cur_param_name == SEED_PARAM_NAME && has_value) {
+                settings_.simulation.seed = std::atol(argv[cur_param + 1]);
+                cur_param += 2;
+            } else if (cur_param_name == LOG_LEVEL_PARAM_NAME && has_value) {
+                if (!Logger::instance().setLevel(argv[cur_param + 1])) {
+                    std::cerr << GetWrongParameterMessage(argv[0], LOG_LEVEL_PARAM_NAME);
+                    exit(0);
+                }
+                cur_param += 2;
+            } else if (cur_param_name == HELP_MESSAGE_NAME) {
+                std::cerr << GetHelpMessage(argv[0]) << "\n";
+                exit(0);
+            } else {
+                std::cerr << GetUnknownParameterMessage(argv[0], argv[cur_param]) << "\n";
+                std::cerr << GetHelpMessage(argv[0]) << "\n";
+                exit(0);
+            }
+        }
+
+        if (settings_.port == 0 || settings_.gamers == 0) {
+            std::cerr << GetHelpMessage(argv[0]) << "\n";
+            exit(0);
+        }
+    }
+
+    const ServerSettings &GetServerSettings() const {
+        return settings_;
+    }
+
+private:
+    const std::string PORT_PARAM_NAME              = "--port";
+    const std::string GAMERS_PARAM_NAME            = "--gamers";
+    const std::string TICKS_PARAM_NAME             = "--ticks";
+    const std::string TICK_MS_PARAM_NAME           = "--tick-ms";
+    const std::string TURN_TIMEOUT_PARAM_NAME      = "--turn-timeout-ms";
+    const std::string KEYFRAME_INTERVAL_PARAM_NAME = "--keyframe-interval";
+    const std::string JSON_ONLY_PARAM_NAME         = "--json-only";
+    const std::string COINS_PARAM_NAME             = "--coins";
+    const std::string FIELD_RADIUS_PARAM_NAME      = "--field-radius";
+    const std::string SEED_PARAM_NAME              = "--seed";
+    const std::string LOG_LEVEL_PARAM_NAME         = "--log-level";
+    const std::string HELP_MESSAGE_NAME            = "--help";
+
+    std::string GetUnknownParameterMessage(const std::string& app_name, const std::string& par_name) {
+        return app_name + ": unknown option " + par_name;
+    }
+
+    std::string GetWrongParameterMessage(const std::string& app_name, const std::string& par_name) {
+        return app_name + ": unknown argument for " + par_name;
+    }
+
+    std::string GetUsageMessage(const std::string& app_name) {
+        return "Try \'" + app_name + " " + HELP_MESSAGE_NAME + "\' for more information";
+    }
+
+    std::string GetHelpMessage(const std::string& app_name) {
+        std::string help_message = "Usage: " + app_name + " " +
+                                        PORT_PARAM_NAME + " PORT " +
+                                        GAMERS_PARAM_NAME + " COUNT" + "\n" +
+                                        "  " + TICKS_PARAM_NAME + "             ticks to play before FINISH (default 1000)" + "\n" +
+                                        "  " + TICK_MS_PARAM_NAME + "           tick length; 0 (default) waits for every gamer's turn" + "\n" +
+                                        "  " + TURN_TIMEOUT_PARAM_NAME + "   longest wait for a turn when ticks wait for gamers (default 1000)" + "\n" +
+                                        "  " + KEYFRAME_INTERVAL_PARAM_NAME + " states between keyframes for binary-delta gamers (default 10)" + "\n" +
+                                        "  " + JSON_ONLY_PARAM_NAME + "         refuse the binary encodings" + "\n" +
+                                        "  " + COINS_PARAM_NAME + "             coins on the field (default 50)" + "\n" +
+                                        "  " + FIELD_RADIUS_PARAM_NAME + "      radius of the round field (default 100)" + "\n" +
+                                        "  " + SEED_PARAM_NAME + "              seed for ball and coin placement" + "\n" +
+                                        "  " + LOG_LEVEL_PARAM_NAME + "         trace, debug, info (default), warning, error or none";
+        return help_message;
+    }
+
+    ServerSettings settings_;
+};
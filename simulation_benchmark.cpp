@@ -0,0 +1,129 @@
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "game_simulation.h"
+
+// Ticks per second of the local server's GameSimulation as balls and coins grow, at a constant
+// coin density. Every configuration is checked once: after a tick no ball may still touch a coin
+// that was on the field before it. That check is the all-pairs scan the spatial hashes replace,
+// so its time is reported next to the tick time. Ball contacts are checked separately on a crowded
+// field, where the hash-based simulation has to end every tick exactly where the all-pairs one does.
+
+SimulationSettings buildSettings(size_t balls_count, size_t coins_count) {
+    SimulationSettings settings;
+    // One coin per 20 square units, and room for the balls
+    settings.fieldRadius = std::sqrt((20.0 * coins_count + 50.0 * balls_count) / M_PI);
+    settings.coinsCount = coins_count;
+    settings.spawnPerTick = std::max<size_t>(coins_count / 100, 1);
+    return settings;
+}
+
+// Random turns, held for a few ticks like a bot chasing a coin
+void steer(GameSimulation &simulation, size_t balls_count, std::mt19937 &random) {
+    std::uniform_real_distribution<double> unit(-1, 1);
+    for (size_t index = random() % 8; index < balls_count; index += 8) {
+        simulation.setAcceleration(index, Acceleration(unit(random), unit(random)));
+    }
+}
+
+// Returns how many coins from before the last step are still within reach of a ball
+size_t countMissedPickups(const GameSimulation &simulation, const SimulationSettings &settings) {
+    const World &world = simulation.world();
+    std::vector<char> added(world.coins.size(), 0);
+    for (size_t index : simulation.diff().addedCoins) {
+        added[index] = 1;
+    }
+    double reach = settings.ballRadius + settings.coinRadius;
+    size_t missed = 0;
+    for (const Ball &ball : world.balls) {
+        for (size_t index = 0; index < world.coins.size(); ++index) {
+            if (!added[index] && dist(ball.position_, world.coins[index].position_) < reach) {
+                ++missed;
+            }
+        }
+    }
+    return missed;
+}
+
+// Returns how many ball states differed between the hash and the all-pairs contacts over all ticks
+size_t countContactMismatches(size_t balls_count, double field_radius, size_t ticks) {
+    SimulationSettings settings;
+    settings.fieldRadius = field_radius;
+    GameSimulation hashed(settings);
+    settings.allPairsContacts = true;
+    GameSimulation all_pairs(settings);
+    for (size_t index = 0; index < balls_count; ++index) {
+        hashed.addBall(index + 1);
+        all_pairs.addBall(index + 1);
+    }
+    std::mt19937 hashed_random(11), all_pairs_random(11);
+    size_t mismatches = 0;
+    for (size_t tick = 0; tick < ticks; ++tick) {
+        steer(hashed, balls_count, hashed_random);
+        steer(all_pairs, balls_count, all_pairs_random);
+        hashed.step();
+        all_pairs.step();
+        const std::vector<Ball> &balls = hashed.world().balls;
+        const std::vector<Ball> &expected = all_pairs.world().balls;
+        for (size_t index = 0; index < balls.size(); ++index) {
+            if (balls[index].position_.x_ != expected[index].position_.x_ ||
+                balls[index].position_.y_ != expected[index].position_.y_ ||
+                balls[index].velocity_.v_x_ != expected[index].velocity_.v_x_ ||
+                balls[index].velocity_.v_y_ != expected[index].velocity_.v_y_) {
+                ++mismatches;
+            }
+        }
+    }
+    return mismatches;
+}
+
+int main() {
+    const size_t balls_counts[] = {10, 100, 1000, 5000};
+    const size_t coins_counts[] = {1000, 10000, 100000};
+    const size_t ticks = 200;
+
+    std::cout << "balls\tcoins\tfield_radius\tticks_per_sec\ttick_us\tall_pairs_scan_us" << std::endl;
+    for (size_t coins_count : coins_counts) {
+        for (size_t balls_count : balls_counts) {
+            SimulationSettings settings = buildSettings(balls_count, coins_count);
+            GameSimulation simulation(settings);
+            for (size_t index = 0; index < balls_count; ++index) {
+                simulation.addBall(index + 1);
+            }
+            std::mt19937 random(7);
+            // Warm up so that balls move and coins are eaten and respawned
+            for (size_t tick = 0; tick < 20; ++tick) {
+                steer(simulation, balls_count, random);
+                simulation.step();
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            for (size_t tick = 0; tick < ticks; ++tick) {
+                steer(simulation, balls_count, random);
+                simulation.step();
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            start = std::chrono::steady_clock::now();
+            size_t missed = countMissedPickups(simulation, settings);
+            double scan_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+            if (missed != 0) {
+                std::cerr << "Error: " << missed << " coins were left under a ball" << std::endl;
+                return 1;
+            }
+
+            std::cout << balls_count << "\t" << coins_count << "\t" << settings.fieldRadius << "\t" << ticks / seconds
+                      << "\t" << seconds * 1e6 / ticks << "\t" << scan_us << std::endl;
+        }
+    }
+
+    size_t mismatches = countContactMismatches(300, 12, 200);
+    if (mismatches != 0) {
+        std::cerr << "Error: " << mismatches << " ball states differ from the all-pairs contacts" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,549 @@
+#ifndef SPATIAL_INDEX_H
+#define SPATIAL_INDEX_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "game_objects.h"
+#include "utils.h"
+#include "world_tracker.h"
+
+// Uniform grid over the coins of one world. Coins are bucketed by cell with a counting sort,
+// so a rebuild is O(n) and reuses the previous storage.
+class CoinGrid {
+private:
+    enum {
+        COINS_PER_CELL = 2,
+        MAX_CELLS_PER_SIDE = 2048
+    };
+
+    double minX_;
+    double minY_;
+    double cellSize_;
+    double inverseCellSize_;
+    int columns_;
+    int rows_;
+    std::vector<int> cellStarts_; // cell c holds order_[cellStarts_[c] .. cellStarts_[c + 1])
+    std::vector<int> order_;      // coin indices sorted by cell
+    std::vector<int> cellOfCoin_;
+    std::vector<int> cellFill_;
+    std::vector<double> builtXs_;  // coins of the last build, to skip rebuilding an unchanged field
+    std::vector<double> builtYs_;
+    WorldColumns scratchColumns_;
+
+    int column(double x) const {
+        return static_cast<int>(std::floor((x - minX_) * inverseCellSize_));
+    }
+
+    int row(double y) const {
+        return static_cast<int>(std::floor((y - minY_) * inverseCellSize_));
+    }
+
+    // Coins lie at or beyond the minimum corner, where truncation equals floor
+    int cellOf(double x, double y) const {
+        int cellColumn = std::min(static_cast<int>((x - minX_) * inverseCellSize_), columns_ - 1);
+        int cellRow = std::min(static_cast<int>((y - minY_) * inverseCellSize_), rows_ - 1);
+        return cellRow * columns_ + cellColumn;
+    }
+
+    template<typename Score>
+    void scanCell(int cellColumn, int cellRow, Score &score, double &bestValue, int &bestIndex) const {
+        if (cellColumn < 0 || cellColumn >= columns_ || cellRow < 0 || cellRow >= rows_) {
+            return;
+        }
+        int cell = cellRow * columns_ + cellColumn;
+        for (int position = cellStarts_[cell]; position < cellStarts_[cell + 1]; ++position) {
+            int index = order_[position];
+            double value = score(index);
+            if (value < bestValue || (value == bestValue && index < bestIndex)) {
+                bestValue = value;
+                bestIndex = index;
+            }
+        }
+    }
+
+public:
+    CoinGrid() : minX_(0), minY_(0), cellSize_(1), inverseCellSize_(1), columns_(0), rows_(0) { }
+
+    // Rebuilds only if the coins differ from the last build; returns whether it rebuilt.
+    // Comparing positions is several times cheaper than bucketing them again.
+    bool update(const World &world) {
+        const WorldColumns &columns = columnsOf(world, scratchColumns_);
+        size_t count = columns.coinXs.size();
+        bool same = count == builtXs_.size() && columns_ > 0 &&
+                    std::equal(builtXs_.begin(), builtXs_.end(), columns.coinXs.data()) &&
+                    std::equal(builtYs_.begin(), builtYs_.end(), columns.coinYs.data());
+        if (same) {
+            return false;
+        }
+        build(world, columns);
+        return true;
+    }
+
+    void build(const World &world) {
+        build(world, columnsOf(world, scratchColumns_));
+    }
+
+    // Cells are no smaller than a coin and hold about COINS_PER_CELL coins on average
+    void build(const World &world, const WorldColumns &columns) {
+        size_t count = columns.coinXs.size();
+        const double *xs = columns.coinXs.data();
+        const double *ys = columns.coinYs.data();
+        builtXs_.assign(xs, xs + count);
+        builtYs_.assign(ys, ys + count);
+        columns_ = rows_ = 0;
+        if (count == 0) {
+            return;
+        }
+        double minX = xs[0], maxX = minX;
+        double minY = ys[0], maxY = minY;
+        for (size_t i = 0; i < count; ++i) {
+            minX = std::min(minX, xs[i]);
+            maxX = std::max(maxX, xs[i]);
+            minY = std::min(minY, ys[i]);
+            maxY = std::max(maxY, ys[i]);
+        }
+        double extent = std::max(maxX - minX, maxY - minY);
+        if (world.field_radius > 0) {
+            extent = std::min(extent, 2 * world.field_radius);
+        }
+        double cellsPerSide = std::sqrt(static_cast<double>(count) / COINS_PER_CELL);
+        cellSize_ = std::max(extent / std::max(cellsPerSide, 1.0), 2 * world.coin_radius);
+        cellSize_ = std::max(cellSize_, (std::max(maxX - minX, maxY - minY) + 1e-9) / MAX_CELLS_PER_SIDE);
+        if (!(cellSize_ > 0)) {
+            cellSize_ = 1;
+        }
+        inverseCellSize_ = 1 / cellSize_;
+        minX_ = minX;
+        minY_ = minY;
+        columns_ = column(maxX) + 1;
+        rows_ = row(maxY) + 1;
+
+        cellStarts_.assign(columns_ * rows_ + 1, 0);
+        cellOfCoin_.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            cellOfCoin_[i] = cellOf(xs[i], ys[i]);
+            ++cellStarts_[cellOfCoin_[i] + 1];
+        }
+        for (size_t cell = 1; cell < cellStarts_.size(); ++cell) {
+            cellStarts_[cell] += cellStarts_[cell - 1];
+        }
+        order_.resize(count);
+        cellFill_.assign(cellStarts_.begin(), cellStarts_.end() - 1);
+        for (size_t i = 0; i < count; ++i) {
+            order_[cellFill_[cellOfCoin_[i]]++] = i;
+        }
+    }
+
+    // Index of the coin with the smallest score (ties go to the smaller index), -1 if there are no coins.
+    // Requires score(i) >= dist(query, coin i) - slack: rings of cells are visited outwards from the
+    // query and the search stops once no farther coin can beat the best score.
+    template<typename Score>
+    int nearest(const Point &query, double slack, Score score) const {
+        double bestValue = std::numeric_limits<double>::max();
+        int bestIndex = -1;
+        if (columns_ == 0) {
+            return bestIndex;
+        }
+        // Searching from the query's projection onto the grid keeps the ring bound valid:
+        // no coin is closer to the projection than to the query itself
+        double queryX = std::min(std::max(query.x_, minX_), minX_ + (columns_ - 1) * cellSize_);
+        double queryY = std::min(std::max(query.y_, minY_), minY_ + (rows_ - 1) * cellSize_);
+        int queryColumn = std::max(0, std::min(column(queryX), columns_ - 1));
+        int queryRow = std::max(0, std::min(row(queryY), rows_ - 1));
+        int maxRing = std::max(std::max(queryColumn, columns_ - 1 - queryColumn),
+                               std::max(queryRow, rows_ - 1 - queryRow));
+        for (int ring = 0; ring <= maxRing; ++ring) {
+            // Only the part of the ring that overlaps the grid is visited
+            int fromColumn = std::max(queryColumn - ring, 0);
+            int toColumn = std::min(queryColumn + ring, columns_ - 1);
+            int fromRow = std::max(queryRow - ring + 1, 0);
+            int toRow = std::min(queryRow + ring - 1, rows_ - 1);
+            for (int cellColumn = fromColumn; cellColumn <= toColumn; ++cellColumn) {
+                scanCell(cellColumn, queryRow - ring, score, bestValue, bestIndex);
+                if (ring > 0) {
+                    scanCell(cellColumn, queryRow + ring, score, bestValue, bestIndex);
+                }
+            }
+            for (int cellRow = fromRow; ring > 0 && cellRow <= toRow; ++cellRow) {
+                scanCell(queryColumn - ring, cellRow, score, bestValue, bestIndex);
+                scanCell(queryColumn + ring, cellRow, score, bestValue, bestIndex);
+            }
+            // Every coin outside the visited rings is at least ring * cellSize_ away
+            if (bestIndex >= 0 && bestValue <= ring * cellSize_ - slack) {
+                break;
+            }
+        }
+        return bestIndex;
+    }
+};
+
+// Static 2-d tree over the coins of one world, stored implicitly: the node of a range [begin, end)
+// keeps its pivot at the middle, split on x at even depths and on y at odd ones.
+class CoinKdTree {
+private:
+    enum {
+        LEAF_SIZE = 8
+    };
+
+    std::vector<int> order_; // coin indices in tree order
+    std::vector<double> xs_; // coordinates in tree order, for cache-friendly leaf scans
+    std::vector<double> ys_;
+
+    void buildRange(int begin, int end, int depth, const double *xs, const double *ys) {
+        if (end - begin <= LEAF_SIZE) {
+            return;
+        }
+        int middle = begin + (end - begin) / 2;
+        const double *keys = depth % 2 == 0 ? xs : ys;
+        std::nth_element(order_.begin() + begin, order_.begin() + middle, order_.begin() + end,
+                         [keys](int first, int second) { return keys[first] < keys[second]; });
+        buildRange(begin, middle, depth + 1, xs, ys);
+        buildRange(middle + 1, end, depth + 1, xs, ys);
+    }
+
+    template<typename Skip>
+    void consider(int position, const Point &query, Skip &skip, double &bestDistance, int &bestIndex) const {
+        int index = order_[position];
+        if (skip(index)) {
+            return;
+        }
+        double dx = xs_[position] - query.x_;
+        double dy = ys_[position] - query.y_;
+        double distance = dx * dx + dy * dy;
+        if (distance < bestDistance || (distance == bestDistance && index < bestIndex)) {
+            bestDistance = distance;
+            bestIndex = index;
+        }
+    }
+
+    template<typename Skip>
+    void nearestInRange(int begin, int end, int depth, const Point &query, Skip &skip,
+                        double &bestDistance, int &bestIndex) const {
+        if (end - begin <= LEAF_SIZE) {
+            double distances[LEAF_SIZE];
+            geometryKernels().squaredDistances(query.x_, query.y_, &xs_[begin], &ys_[begin], end - begin, distances);
+            for (int position = begin; position < end; ++position) {
+                double distance = distances[position - begin];
+                int index = order_[position];
+                if ((distance < bestDistance || (distance == bestDistance && index < bestIndex)) && !skip(index)) {
+                    bestDistance = distance;
+                    bestIndex = index;
+                }
+            }
+            return;
+        }
+        int middle = begin + (end - begin) / 2;
+        consider(middle, query, skip, bestDistance, bestIndex);
+        double diff = depth % 2 == 0 ? query.x_ - xs_[middle] : query.y_ - ys_[middle];
+        if (diff < 0) {
+            nearestInRange(begin, middle, depth + 1, query, skip, bestDistance, bestIndex);
+            if (diff * diff <= bestDistance) {
+                nearestInRange(middle + 1, end, depth + 1, query, skip, bestDistance, bestIndex);
+            }
+        } else {
+            nearestInRange(middle + 1, end, depth + 1, query, skip, bestDistance, bestIndex);
+            if (diff * diff <= bestDistance) {
+                nearestInRange(begin, middle, depth + 1, query, skip, bestDistance, bestIndex);
+            }
+        }
+    }
+
+public:
+    // Indices are positions in the coordinate arrays
+    void build(const double *xs, const double *ys, int size) {
+        order_.resize(size);
+        for (int i = 0; i < size; ++i) {
+            order_[i] = i;
+        }
+        buildRange(0, size, 0, xs, ys);
+        xs_.resize(size);
+        ys_.resize(size);
+        for (int position = 0; position < size; ++position) {
+            xs_[position] = xs[order_[position]];
+            ys_[position] = ys[order_[position]];
+        }
+    }
+
+    void build(const WorldColumns &columns) {
+        build(columns.coinXs.data(), columns.coinYs.data(), columns.coinXs.size());
+    }
+
+    // Closest coin to query for which skip(index) is false; ties go to the smaller index, -1 if none
+    template<typename Skip>
+    int nearest(const Point &query, Skip skip) const {
+        double bestDistance = std::numeric_limits<double>::max();
+        int bestIndex = -1;
+        nearestInRange(0, order_.size(), 0, query, skip, bestDistance, bestIndex);
+        return bestIndex;
+    }
+};
+
+// Coin index kept up to date from the tracker's diffs instead of being rebuilt every world.
+// Removed coins become tombstones in the k-d tree and added coins go to a small side list;
+// the tree is rebuilt only when either grows too large. Coins are addressed by slot: tree slots
+// come first, then the side list. Slots stay valid until the next apply().
+class IncrementalCoinIndex {
+private:
+    enum {
+        MAX_EXTRA_COINS = 32,
+        MAX_DEAD_FRACTION_INVERSE = 4
+    };
+
+    CoinKdTree tree_;
+    std::vector<double> xs_;  // by slot
+    std::vector<double> ys_;  // by slot
+    std::vector<CoinId> ids_; // by slot
+    std::vector<char> alive_;      // by slot
+    size_t treeSize_;
+    size_t deadInTree_;
+    std::unordered_map<CoinId, size_t> slotById_;
+    WorldColumns scratchColumns_;
+
+    void rebuild(const World &world, const WorldTracker &tracker) {
+        const WorldColumns &columns = columnsOf(world, scratchColumns_);
+        tree_.build(columns);
+        treeSize_ = world.coins.size();
+        deadInTree_ = 0;
+        xs_.assign(columns.coinXs.data(), columns.coinXs.data() + treeSize_);
+        ys_.assign(columns.coinYs.data(), columns.coinYs.data() + treeSize_);
+        ids_.resize(treeSize_);
+        alive_.assign(treeSize_, true);
+        slotById_.clear();
+        for (size_t i = 0; i < treeSize_; ++i) {
+            ids_[i] = tracker.coinId(i);
+            slotById_.emplace(ids_[i], i);
+        }
+    }
+
+    void remove(CoinId id) {
+        auto it = slotById_.find(id);
+        if (it == slotById_.end()) {
+            return;
+        }
+        size_t slot = it->second;
+        slotById_.erase(it);
+        if (slot < treeSize_) {
+            alive_[slot] = false;
+            ++deadInTree_;
+            return;
+        }
+        // Side list slots are compacted by moving the last one into the hole
+        size_t last = xs_.size() - 1;
+        if (slot != last) {
+            xs_[slot] = xs_[last];
+            ys_[slot] = ys_[last];
+            ids_[slot] = ids_[last];
+            slotById_[ids_[slot]] = slot;
+        }
+        xs_.pop_back();
+        ys_.pop_back();
+        ids_.pop_back();
+        alive_.pop_back();
+    }
+
+public:
+    IncrementalCoinIndex() : treeSize_(0), deadInTree_(0) { }
+
+    // Applies the diff of the world the tracker has just matched
+    void apply(const World &world, const WorldTracker &tracker, const WorldDiff &diff) {
+        size_t extra = xs_.size() - treeSize_ + diff.addedCoins.size();
+        if (extra > MAX_EXTRA_COINS ||
+            (deadInTree_ + diff.removedCoins.size()) * MAX_DEAD_FRACTION_INVERSE > treeSize_ + MAX_EXTRA_COINS) {
+            rebuild(world, tracker);
+            return;
+        }
+        for (CoinId id : diff.removedCoins) {
+            remove(id);
+        }
+        for (size_t index : diff.addedCoins) {
+            slotById_.emplace(tracker.coinId(index), xs_.size());
+            xs_.push_back(world.coins[index].position_.x_);
+            ys_.push_back(world.coins[index].position_.y_);
+            ids_.push_back(tracker.coinId(index));
+            alive_.push_back(true);
+        }
+    }
+
+    size_t slots() const {
+        return xs_.size();
+    }
+
+    bool alive(size_t slot) const {
+        return alive_[slot] != 0;
+    }
+
+    Point position(size_t slot) const {
+        return Point(xs_[slot], ys_[slot]);
+    }
+
+    CoinId id(size_t slot) const {
+        return ids_[slot];
+    }
+
+    // Closest live slot for which skip(slot) is false; ties go to the smaller slot, -1 if none
+    template<typename Skip>
+    int nearest(const Point &query, Skip skip) const {
+        int best = tree_.nearest(query, [&](int slot) { return !alive_[slot] || skip(slot); });
+        double bestDistance = std::numeric_limits<double>::max();
+        if (best >= 0) {
+            double dx = xs_[best] - query.x_;
+            double dy = ys_[best] - query.y_;
+            bestDistance = dx * dx + dy * dy;
+        }
+        // apply() keeps the side list within MAX_EXTRA_COINS
+        double distances[MAX_EXTRA_COINS];
+        size_t extra = xs_.size() - treeSize_;
+        geometryKernels().squaredDistances(query.x_, query.y_, xs_.data() + treeSize_, ys_.data() + treeSize_, extra,
+                                           distances);
+        for (size_t slot = treeSize_; slot < xs_.size(); ++slot) {
+            double distance = distances[slot - treeSize_];
+            if (distance < bestDistance && !skip(slot)) {
+                bestDistance = distance;
+                best = slot;
+            }
+        }
+        return best;
+    }
+};
+
+// Uniform spatial hash for items that move or come and go every tick, as on the local server.
+// Cells of a fixed size are hashed into a power-of-two table of buckets, so the field needs no
+// bounds, and the table doubles whenever there are more items than buckets. Items are dense indices
+// in insertion order; an item that stays in its cell is moved with two floor()s, and removal
+// mirrors World's swap-and-pop.
+class SpatialHash {
+private:
+    enum {
+        MIN_BUCKETS = 64
+    };
+
+    double cellSize_;
+    double inverseCellSize_;
+    size_t mask_;
+    std::vector<std::vector<int>> buckets_;
+    std::vector<long long> columnOf_; // cell of item i
+    std::vector<long long> rowOf_;
+    std::vector<size_t> bucketOf_;    // bucket of item i
+    std::vector<int> slotOf_;         // position of item i in its bucket
+    std::vector<size_t> visited_;  // buckets of the running query, as distinct cells may share one
+
+    long long cell(double value) const {
+        return static_cast<long long>(std::floor(value * inverseCellSize_));
+    }
+
+    size_t bucket(long long column, long long row) const {
+        // The usual large primes for 2-d spatial hashing
+        return static_cast<size_t>((column * 73856093LL) ^ (row * 19349663LL)) & mask_;
+    }
+
+    void link(int item, size_t target) {
+        bucketOf_[item] = target;
+        slotOf_[item] = buckets_[target].size();
+        buckets_[target].push_back(item);
+    }
+
+    void grow() {
+        mask_ = 2 * mask_ + 1;
+        for (std::vector<int> &items : buckets_) {
+            items.clear();
+        }
+        buckets_.resize(mask_ + 1);
+        for (size_t item = 0; item < bucketOf_.size(); ++item) {
+            link(item, bucket(columnOf_[item], rowOf_[item]));
+        }
+    }
+
+    void unlink(int item) {
+        std::vector<int> &items = buckets_[bucketOf_[item]];
+        int last = items.back();
+        items[slotOf_[item]] = last;
+        slotOf_[last] = slotOf_[item];
+        items.pop_back();
+    }
+
+public:
+    // Queries are cheapest with cells about as large as the query radius; the table starts with
+    // two buckets per expected item
+    SpatialHash(double cellSize, size_t expectedItems)
+            : cellSize_(cellSize), inverseCellSize_(1 / cellSize), mask_(MIN_BUCKETS - 1) {
+        while (mask_ + 1 < 2 * expectedItems) {
+            mask_ = 2 * mask_ + 1;
+        }
+        buckets_.resize(mask_ + 1);
+    }
+
+    size_t size() const {
+        return bucketOf_.size();
+    }
+
+    // Adds item size() at the given position
+    void insert(double x, double y) {
+        columnOf_.push_back(cell(x));
+        rowOf_.push_back(cell(y));
+        bucketOf_.push_back(0);
+        slotOf_.push_back(0);
+        link(bucketOf_.size() - 1, bucket(columnOf_.back(), rowOf_.back()));
+        if (bucketOf_.size() > buckets_.size()) {
+            grow();
+        }
+    }
+
+    void move(int item, double x, double y) {
+        long long column = cell(x);
+        long long row = cell(y);
+        if (column != columnOf_[item] || row != rowOf_[item]) {
+            columnOf_[item] = column;
+            rowOf_[item] = row;
+            unlink(item);
+            link(item, bucket(column, row));
+        }
+    }
+
+    // Removes item, then renames the last item to item
+    void removeSwapLast(int item) {
+        unlink(item);
+        int last = bucketOf_.size() - 1;
+        if (item != last) {
+            buckets_[bucketOf_[last]][slotOf_[last]] = item;
+            columnOf_[item] = columnOf_[last];
+            rowOf_[item] = rowOf_[last];
+            bucketOf_[item] = bucketOf_[last];
+            slotOf_[item] = slotOf_[last];
+        }
+        columnOf_.pop_back();
+        rowOf_.pop_back();
+        bucketOf_.pop_back();
+        slotOf_.pop_back();
+    }
+
+    // Calls visit(item) once for every item in the cells the square around (x, y) touches: a superset
+    // of the items within radius, which the caller filters. Items must not be added or removed meanwhile.
+    template<typename Visit>
+    void forEachNear(double x, double y, double radius, Visit visit) {
+        visited_.clear();
+        long long fromColumn = cell(x - radius), toColumn = cell(x + radius);
+        long long fromRow = cell(y - radius), toRow = cell(y + radius);
+        for (long long row = fromRow; row <= toRow; ++row) {
+            for (long long column = fromColumn; column <= toColumn; ++column) {
+                size_t target = bucket(column, row);
+                if (std::find(visited_.begin(), visited_.end(), target) != visited_.end()) {
+                    continue;
+                }
+                visited_.push_back(target);
+                for (int item : buckets_[target]) {
+                    visit(item);
+                }
+            }
+        }
+    }
+
+    double cellSize() const {
+        return cellSize_;
+    }
+};
+
+#endif
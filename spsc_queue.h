@@ -0,0 +1,69 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Elements are moved in and out of preallocated slots, so a queue of vectors keeps their storage.
+template<typename T>
+class SpscQueue {
+private:
+    enum {
+        CACHE_LINE_SIZE = 64
+    };
+
+    std::vector<T> slots_;
+    size_t mask_;
+
+    char headPadding_[CACHE_LINE_SIZE];
+    std::atomic<size_t> head_; // next slot to pop, written by the consumer
+    char tailPadding_[CACHE_LINE_SIZE];
+    std::atomic<size_t> tail_; // next slot to push, written by the producer
+    char endPadding_[CACHE_LINE_SIZE];
+
+    static size_t roundUpToPowerOfTwo(size_t value) {
+        size_t result = 1;
+        while (result < value) {
+            result <<= 1;
+        }
+        return result;
+    }
+
+public:
+    explicit SpscQueue(size_t capacity)
+            : slots_(roundUpToPowerOfTwo(capacity)), mask_(slots_.size() - 1), head_(0), tail_(0) { }
+
+    SpscQueue(const SpscQueue &) = delete;
+
+    SpscQueue &operator=(const SpscQueue &) = delete;
+
+    // Producer side: returns false if the queue is full
+    bool tryPush(T &&value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == slots_.size()) {
+            return false;
+        }
+        slots_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side: returns false if the queue is empty
+    bool tryPop(T &value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+};
+
+#endif
@@ -1,12 +1,22 @@
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <deque>
+#include <functional>
 #include <numeric>
 #include <limits>
 #include <set>
 
 #include "game_objects.h"
 #include "utils.h"
+#include "spatial_index.h"
+#include "world_tracker.h"
+#include "thread_pool.h"
+#include "held_karp.h"
+#include "route_improver.h"
+#include "estimators.h"
+#include "logger.h"
 
 #pragma once
 
@@ -20,22 +30,32 @@ public:
         return false;
     }
 
+    // Same as above, but may use the ids the tracker gave to the world's coins
+    virtual bool isActual(const World &world, const Ball &ball, const WorldTracker & /* tracker */) {
+        return isActual(world, ball);
+    }
+
     virtual ~StrategyTask() { }
 };
 
 class TakeCoinTask : public StrategyTask {
 private:
     Coin target_;
+    CoinId targetId_;
 
 public:
-    TakeCoinTask(const Coin &coin)
-            : target_(coin) {
+    TakeCoinTask(const Coin &coin, CoinId coinId = NO_COIN_ID)
+            : target_(coin), targetId_(coinId) {
     }
 
     Point getTargetPoint(const World &world, const Ball &ball) {
         return target_.position_;
     }
 
+    const Coin &target() const {
+        return target_;
+    }
+
     bool isActual(const World &world, const Ball &ball) {
         for (auto coin : world.coins) {
             if (dist(target_.position_, coin.position_) < 1e-2) {
@@ -44,20 +64,37 @@ public:
         }
         return false;
     }
+
+    bool isActual(const World &world, const Ball &ball, const WorldTracker &tracker) {
+        if (targetId_ == NO_COIN_ID) {
+            return isActual(world, ball);
+        }
+        return tracker.hasCoin(targetId_);
+    }
 };
 
 typedef std::shared_ptr<StrategyTask> StrategyTaskPtr;
 
 class GlobalStrategy {
+public:
+    typedef std::chrono::steady_clock Clock;
+
 private:
     int updateTime_;
     int timeWithoutUpdate_;
     std::deque<StrategyTaskPtr> cachedTasks_;
+    WorldTracker tracker_;
+    std::atomic<Clock::rep> turnDeadline_; // ticks since the clock's epoch, 0 for none
+    Point lastBallPosition_;
+    bool hasLastBall_;
+    RouteImprover improver_;
+    std::vector<Point> routePoints_;
+    std::vector<int> improvedOrder_;
 
     void removeNonActualTasks(const World &world, const Ball &ball) {
         while (!cachedTasks_.empty()) {
             auto task = cachedTasks_.front();
-            if (task->isActual(world, ball)) {
+            if (task->isActual(world, ball, tracker_)) {
                 break;
             }
             cachedTasks_.pop_front();
@@ -66,12 +103,20 @@ private:
 
 public:
     GlobalStrategy(int updateTime)
-            : updateTime_(updateTime), timeWithoutUpdate_(0) {
+            : updateTime_(updateTime), timeWithoutUpdate_(0), turnDeadline_(0), hasLastBall_(false) {
     }
 
     virtual ~GlobalStrategy() { }
 
+    // Time by which the current turn has to be sent; may be set from another thread
+    void setTurnDeadline(Clock::time_point deadline) {
+        turnDeadline_.store(deadline.time_since_epoch().count(), std::memory_order_relaxed);
+    }
+
     StrategyTaskPtr getTask(const World &world, const Ball &ball) {
+        onWorldChanged(world, tracker_.update(world));
+        lastBallPosition_ = ball.position_;
+        hasLastBall_ = true;
         removeNonActualTasks(world, ball);
         if (timeWithoutUpdate_ == updateTime_ || cachedTasks_.empty()) {
             cachedTasks_ = estimateActions(world, ball);
@@ -86,6 +131,53 @@ public:
     }
 
     virtual std::deque<StrategyTaskPtr> estimateActions(const World &world, const Ball &ball) = 0;
+
+    // Reorders the cached coin tasks with 2-opt and Or-opt moves, starting from the ball's last position,
+    // until stop() returns true or no move shortens the route. Must not run concurrently with getTask.
+    template<typename Stop>
+    bool improveTasks(Stop stop) {
+        if (!hasLastBall_ || cachedTasks_.size() < 2) {
+            return false;
+        }
+        routePoints_.clear();
+        for (const StrategyTaskPtr &task : cachedTasks_) {
+            const TakeCoinTask *coinTask = dynamic_cast<const TakeCoinTask *>(task.get());
+            if (!coinTask) {
+                return false;
+            }
+            routePoints_.push_back(coinTask->target().position_);
+        }
+        improver_.reset(lastBallPosition_, routePoints_);
+        if (!improver_.improve(stop)) {
+            return false;
+        }
+        improver_.order(improvedOrder_);
+        std::deque<StrategyTaskPtr> improved;
+        for (int index : improvedOrder_) {
+            improved.push_back(cachedTasks_[index]);
+        }
+        cachedTasks_.swap(improved);
+        LOG_DEBUG("Improved route through %zu coins to length %f", cachedTasks_.size(), improver_.cost());
+        return true;
+    }
+
+protected:
+    // Called for every world before any task is picked, with its difference from the previous one
+    virtual void onWorldChanged(const World & /* world */, const WorldDiff & /* diff */) { }
+
+    // Stable ids of the current world's coins
+    const WorldTracker &tracker() const {
+        return tracker_;
+    }
+
+    // Time left until the turn deadline, max() if no deadline was set
+    Clock::duration timeLeft() const {
+        Clock::rep deadline = turnDeadline_.load(std::memory_order_relaxed);
+        if (deadline == 0) {
+            return Clock::duration::max();
+        }
+        return Clock::time_point(Clock::duration(deadline)) - Clock::now();
+    }
 };
 
 typedef std::function<double(const World &, const Ball &, const Coin &)> Estimator;
@@ -95,7 +187,7 @@ double naiveDistEstimator(const World &, const Ball &ball, const Coin &coin) {
 }
 
 Estimator createVelocityDistEstimator(double velocityCoeff) {
-    return [&](const World &, const Ball &ball, const Coin &coin) {
+    return [=](const World &, const Ball &ball, const Coin &coin) {
         Point point(ball.position_.x_ + ball.velocity_.v_x_,
                     ball.position_.y_ + ball.velocity_.v_y_);
 
@@ -105,7 +197,7 @@ Estimator createVelocityDistEstimator(double velocityCoeff) {
 }
 
 Estimator createAreaDensityEstimator(double densityCoeff) {
-    return [&](const World &world, const Ball &ball, const Coin &coin) {
+    return [=](const World &world, const Ball &ball, const Coin &coin) {
         double ans = 0;
         for (const Ball& nBall : world.balls) {
             if ((nBall.position_.x_ - ball.position_.x_) * (nBall.position_.x_ - coin.position_.x_) < 0 &&
@@ -134,107 +226,258 @@ Estimator createComboEstimator(Estimator first, Estimator second) {
     };
 }
 
-class NearestCoinStrategy : public GlobalStrategy {
+// Scorer is an Estimator or an estimator expression from estimators.h; with an expression the scoring
+// of a coin inlines into the search loop.
+template<typename Scorer>
+class BasicNearestCoinStrategy : public GlobalStrategy {
 private:
-    Estimator estimator_;
+    Scorer estimator_;
+    double estimatorSlack_;
+    CoinGrid grid_;
 
 public:
-    NearestCoinStrategy(int updateTime, Estimator estimator = createVelocityDistEstimator(0))
-            : GlobalStrategy(updateTime), estimator_(estimator) {
+    // estimatorSlack bounds the estimator from below: estimator >= dist(ball, coin) - estimatorSlack.
+    // Pass infinity for estimators without such a bound to scan every coin.
+    BasicNearestCoinStrategy(int updateTime, Scorer estimator, double estimatorSlack)
+            : GlobalStrategy(updateTime), estimator_(estimator), estimatorSlack_(estimatorSlack) {
     }
 
     std::deque<StrategyTaskPtr> estimateActions(const World &world, const Ball &ball) {
         std::deque<StrategyTaskPtr> result;
-        double dst = std::numeric_limits<double>::max();
+        prepareEstimator(estimator_, world, ball);
         int pos = -1;
-        for (int i = 0; i < world.coins.size(); ++i) {
-            double value = estimator_(world, ball, world.coins[i]);
-            if (value < dst) {
-                dst = value;
-                pos = i;
+        if (estimatorSlack_ < std::numeric_limits<double>::infinity()) {
+            grid_.update(world);
+            pos = grid_.nearest(ball.position_, estimatorSlack_, [&](int i) {
+                return estimator_(world, ball, world.coins[i]);
+            });
+        } else {
+            double dst = std::numeric_limits<double>::max();
+            for (int i = 0; i < world.coins.size(); ++i) {
+                double value = estimator_(world, ball, world.coins[i]);
+                if (value < dst) {
+                    dst = value;
+                    pos = i;
+                }
             }
         }
         if (pos >= 0) {
-            result.emplace_back(new TakeCoinTask(world.coins[pos]));
+            result.emplace_back(new TakeCoinTask(world.coins[pos], tracker().coinId(pos)));
         }
         return result;
     }
 };
 
+class NearestCoinStrategy : public BasicNearestCoinStrategy<Estimator> {
+public:
+    // Scores coins by their distance, so the grid search is exact
+    explicit NearestCoinStrategy(int updateTime)
+            : BasicNearestCoinStrategy<Estimator>(updateTime, createVelocityDistEstimator(0), 0) {
+    }
+
+    // Nothing is known about an arbitrary estimator, so every coin is scanned unless the caller
+    // passes a slack that bounds it, as described for BasicNearestCoinStrategy
+    NearestCoinStrategy(int updateTime, Estimator estimator,
+                        double estimatorSlack = std::numeric_limits<double>::infinity())
+            : BasicNearestCoinStrategy<Estimator>(updateTime, estimator, estimatorSlack) {
+    }
+};
+
+// NearestCoinStrategy over an estimator expression, with the grid search slack taken from its bounds
+template<typename Expression>
+GlobalStrategy *createNearestCoinStrategy(int updateTime, const Expression &expression) {
+    return new BasicNearestCoinStrategy<Expression>(updateTime, expression, estimatorSlack(expression));
+}
+
 class KNearestCoinsStrategy : public GlobalStrategy {
 private:
-    int kValue_;
+    enum {
+        CHUNKS_PER_WORKER = 8
+    };
+
+    // Best route over the starts a worker has tried, with its own scratch space
+    struct RouteSearch {
+        std::vector<char> usedInRoute;
+        std::vector<int> route;
+        std::vector<int> bestRoute;
+        double bestLen;
+        int bestStart;
+    };
 
-    std::vector<std::vector<double>> buildDistances(const World &world) {
-        std::vector<std::vector<double>> dists(world.coins.size());
-        for (size_t i = 0; i < dists.size(); ++i) {
-            for (size_t j = 0; j < dists.size(); ++j) {
-                dists[i].push_back(dist(world.coins[i].position_, world.coins[j].position_));
+    int kValue_;
+    IncrementalCoinIndex index_;
+    std::unique_ptr<WorkStealingPool> pool_;
+    std::vector<RouteSearch> searches_;
+
+    void searchFrom(int start, const Ball &ball, RouteSearch &search) const {
+        auto isUsed = [&search](int slot) {
+            return search.usedInRoute[slot] != 0;
+        };
+        int curr = start;
+        double len = dist(ball.position_, index_.position(start));
+        search.usedInRoute[start] = true;
+        search.route.assign(1, start);
+
+        for (int iter = 1; iter < kValue_; ++iter) {
+            int newCurr = index_.nearest(index_.position(curr), isUsed);
+            if (newCurr < 0) {
+                break;
             }
+            len += dist(index_.position(curr), index_.position(newCurr));
+            curr = newCurr;
+            search.usedInRoute[curr] = true;
+            search.route.push_back(curr);
+        }
+        // Workers see starts in any order, so equal lengths go to the smaller start as in a serial scan
+        if (len < search.bestLen || (len == search.bestLen && start < search.bestStart)) {
+            search.bestLen = len;
+            search.bestStart = start;
+            search.bestRoute = search.route;
+        }
+        for (int slot : search.route) {
+            search.usedInRoute[slot] = false;
         }
-        return dists;
     }
 
-    std::vector<std::vector<int>> sortedNeighboures(const std::vector<std::vector<double>> &dists) {
-        std::vector<std::vector<int>> nearests(dists.size());
-        for (size_t i = 0; i < dists.size(); ++i) {
-            nearests[i].assign(dists.size(), 0);
-            std::iota(nearests[i].begin(), nearests[i].end(), 0);
-            auto comparator = [&](int first, int second) {
-                return dists[i][first] < dists[i][second] ||
-                       dists[i][first] == dists[i][second] && first < second;
-            };
-            std::sort(nearests[i].begin(), nearests[i].end(), comparator);
-        }
-        return nearests;
+protected:
+    void onWorldChanged(const World &world, const WorldDiff &diff) {
+        index_.apply(world, tracker(), diff);
     }
 
 public:
 
-    KNearestCoinsStrategy(int updateTime, int kValue)
-            : GlobalStrategy(updateTime), kValue_(kValue) {
+    // threads > 1 spreads the route search over a thread pool; the chosen route does not depend on it
+    KNearestCoinsStrategy(int updateTime, int kValue, int threads = 1)
+            : GlobalStrategy(updateTime), kValue_(kValue),
+              pool_(threads > 1 ? new WorkStealingPool(threads) : nullptr),
+              searches_(std::max(threads, 1)) {
     }
 
+    // Greedy route of up to kValue_ coins from every start coin; each step asks the coin index
+    // for the nearest coin not yet in the route, so a replan costs O(n * k * log n) time and O(n) memory.
+    // The index follows the world's diffs, so only the route search itself is redone per replan.
     std::deque<StrategyTaskPtr> estimateActions(const World &world, const Ball &ball) {
         std::deque<StrategyTaskPtr> result;
-        std::vector<std::vector<double>> dists = buildDistances(world);
-        int coinsAmount = world.coins.size();
-        std::vector<std::vector<int>> nearests = sortedNeighboures(dists);
+        int slots = index_.slots();
+        for (RouteSearch &search : searches_) {
+            search.usedInRoute.assign(slots, false);
+            search.bestRoute.clear();
+            search.bestLen = std::numeric_limits<double>::max();
+            search.bestStart = slots;
+        }
+        auto searchChunk = [&](size_t worker, size_t from, size_t to) {
+            for (size_t start = from; start < to; ++start) {
+                if (index_.alive(start)) {
+                    searchFrom(start, ball, searches_[worker]);
+                }
+            }
+        };
+        if (pool_) {
+            size_t chunks = pool_->workers() * CHUNKS_PER_WORKER;
+            pool_->parallelFor(0, slots, (slots + chunks - 1) / chunks, searchChunk);
+        } else {
+            searchChunk(0, 0, slots);
+        }
 
-        double bestLen = std::numeric_limits<double>::max();
-        std::vector<int> bestRoute;
+        const RouteSearch *best = &searches_[0];
+        for (const RouteSearch &search : searches_) {
+            if (search.bestLen < best->bestLen ||
+                (search.bestLen == best->bestLen && search.bestStart < best->bestStart)) {
+                best = &search;
+            }
+        }
+        for (int slot : best->bestRoute) {
+            int pos = tracker().coinIndex(index_.id(slot));
+            result.emplace_back(new TakeCoinTask(world.coins[pos], index_.id(slot)));
+        }
+        return result;
+    }
+};
 
-        for (int start = 0; start < dists.size(); ++start) {
-            std::vector<char> usedInRoute(dists.size());
-            std::vector<int> nextCandidates(dists.size());
+// Takes the coins closest to the ball and visits them in the exactly shortest order. The number of
+// coins is the largest that fits into half of the time left for the turn, judging by the speed of
+// earlier solves, and at most maxCoins.
+class HeldKarpStrategy : public GlobalStrategy {
+private:
+    int maxCoins_;
+    double nanosPerStep_;
+    IncrementalCoinIndex index_;
+    HeldKarpSolver solver_;
+    std::vector<char> taken_;
+    std::vector<int> candidates_;
+    std::vector<double> xs_;
+    std::vector<double> ys_;
+    std::vector<double> startDistances_;
+    std::vector<double> distances_;
+    std::vector<int> path_;
+
+    int chooseCoinsCount() const {
+        int count = maxCoins_;
+        Clock::duration left = timeLeft();
+        if (left == Clock::duration::max()) {
+            return count;
+        }
+        double nanosLeft = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count() / 2.0;
+        while (count > 1 && HeldKarpSolver::steps(count) * nanosPerStep_ > nanosLeft) {
+            --count;
+        }
+        return count;
+    }
 
-            int curr = start;
-            double len = dist(ball.position_, world.coins[start].position_);
-            usedInRoute[start] = true;
-            std::vector<int> route({start});
+protected:
+    void onWorldChanged(const World &world, const WorldDiff &diff) {
+        index_.apply(world, tracker(), diff);
+    }
 
-            for (int iter = 1; iter < kValue_; ++iter) {
-                while (nextCandidates[curr] < coinsAmount && usedInRoute[nearests[curr][nextCandidates[curr]]]) {
-                    ++nextCandidates[curr];
-                }
-                if (nextCandidates[curr] == coinsAmount) {
-                    break;
-                }
-                int newCurr = nearests[curr][nextCandidates[curr]];
-                len += dist(world.coins[curr].position_, world.coins[newCurr].position_);
-                curr = newCurr;
-                usedInRoute[curr] = true;
-                route.push_back(curr);
-            }
-            if (len < bestLen) {
-                bestLen = len;
-                bestRoute = route;
+public:
+    HeldKarpStrategy(int updateTime, int maxCoins)
+            : GlobalStrategy(updateTime),
+              maxCoins_(std::max(1, std::min<int>(maxCoins, HeldKarpSolver::MAX_POINTS))), nanosPerStep_(1) {
+    }
+
+    std::deque<StrategyTaskPtr> estimateActions(const World &world, const Ball &ball) {
+        std::deque<StrategyTaskPtr> result;
+        int count = chooseCoinsCount();
+
+        taken_.assign(index_.slots(), false);
+        candidates_.clear();
+        while (static_cast<int>(candidates_.size()) < count) {
+            int slot = index_.nearest(ball.position_, [this](int slot) { return taken_[slot] != 0; });
+            if (slot < 0) {
+                break;
             }
+            taken_[slot] = true;
+            candidates_.push_back(slot);
+        }
+        count = candidates_.size();
+        if (count == 0) {
+            return result;
         }
 
+        xs_.resize(count);
+        ys_.resize(count);
+        for (int point = 0; point < count; ++point) {
+            xs_[point] = index_.position(candidates_[point]).x_;
+            ys_[point] = index_.position(candidates_[point]).y_;
+        }
+        startDistances_.resize(count);
+        distances_.resize(count * count);
+        const GeometryKernels &kernels = geometryKernels();
+        kernels.distances(ball.position_.x_, ball.position_.y_, xs_.data(), ys_.data(), count, startDistances_.data());
+        for (int from = 0; from < count; ++from) {
+            kernels.distances(xs_[from], ys_[from], xs_.data(), ys_.data(), count, &distances_[from * count]);
+        }
+        Clock::time_point start = Clock::now();
+        solver_.solve(startDistances_, distances_, count, path_);
+        double nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        if (count > 4) {
+            nanosPerStep_ = std::max(nanos / HeldKarpSolver::steps(count), 1e-3);
+        }
+        LOG_DEBUG("Held-Karp route through %d coins", count);
 
-        for (int pos : bestRoute) {
-            result.emplace_back(new TakeCoinTask(world.coins[pos]));
+        for (int point : path_) {
+            CoinId id = index_.id(candidates_[point]);
+            result.emplace_back(new TakeCoinTask(world.coins[tracker().coinIndex(id)], id));
         }
         return result;
     }
@@ -252,7 +495,7 @@ class FirstMovementStrategyImpl : public MovementStrategy {
     Acceleration getAcceleration(const World &world,
                                  StrategyTaskPtr strategyTaskPtr, const Ball &ball) {
         Point targerPoint = strategyTaskPtr->getTargetPoint(world, ball);
-        std::cerr << "Target: " << targerPoint.x_ << " " << targerPoint.y_ << std::endl;
+        LOG_DEBUG("Target: %f %f", targerPoint.x_, targerPoint.y_);
         Velocity currentVelocity = ball.velocity_;
         Point currentPosition = ball.position_;
 
@@ -271,7 +514,7 @@ class SecondMovementStrategyImpl : public MovementStrategy {
         Point targerPoint = strategyTaskPtr->getTargetPoint(world, ball);
         Velocity currentVelocity = ball.velocity_;
         Point currentPosition = ball.position_;
-        std::cerr << "Target: " << targerPoint.x_ << " " << targerPoint.y_ << std::endl;
+        LOG_DEBUG("Target: %f %f", targerPoint.x_, targerPoint.y_);
         
         Point targetRelative(targerPoint.x_ - currentPosition.x_, targerPoint.y_ - currentPosition.y_);
         Point targetRelaviteNorm(targetRelative.x_ / (getNorm(targetRelative) + 1e-4), targetRelative.y_ / (getNorm(targetRelative) + 1e-4));
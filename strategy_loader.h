@@ -1,4 +1,5 @@
 #include "strategy.h"
+#include <map>
 #include <memory>
 
 #pragma once
@@ -11,4 +12,55 @@ std::shared_ptr<GlobalStrategy> createGlobalStrategy(const std::vector<std::stri
     } else {
         return nullptr;
     }
-}
\ No newline at end of file
+}
+
+// Named estimators for NearestCoinStrategy. Each entry instantiates the strategy over its own
+// expression type, so picking an estimator at runtime keeps the scoring inlined.
+class EstimatorRegistry {
+public:
+    typedef std::function<GlobalStrategy *(int updateTime)> Factory;
+
+private:
+    std::map<std::string, Factory> factories_;
+
+    template<typename Expression>
+    void addExpression(const std::string &name, const Expression &expression) {
+        factories_[name] = [expression](int updateTime) {
+            return createNearestCoinStrategy(updateTime, expression);
+        };
+    }
+
+public:
+    EstimatorRegistry() {
+        addExpression("distance", distanceTerm());
+        addExpression("velocity", distanceTerm() + 3 * velocityTurnTerm());
+        addExpression("area-density", distanceTerm() + 20 * gridAreaDensityTerm());
+        addExpression("coin-density", distanceTerm() + 100 * gridCoinDensityTerm(50));
+        addExpression("combo", distanceTerm() + 3 * velocityTurnTerm() + 20 * gridAreaDensityTerm());
+        addExpression("exact-area-density", distanceTerm() + 20 * areaDensityTerm());
+        addExpression("exact-coin-density", distanceTerm() + 100 * coinDensityTerm(GaussianKernel(50)));
+    }
+
+    static EstimatorRegistry &instance() {
+        static EstimatorRegistry registry;
+        return registry;
+    }
+
+    void add(const std::string &name, const Factory &factory) {
+        factories_[name] = factory;
+    }
+
+    // nullptr for an unknown name
+    GlobalStrategy *create(const std::string &name, int updateTime) const {
+        auto found = factories_.find(name);
+        return found == factories_.end() ? nullptr : found->second(updateTime);
+    }
+
+    std::string names() const {
+        std::string result;
+        for (const auto &entry : factories_) {
+            result += (result.empty() ? "" : ", ") + entry.first;
+        }
+        return result;
+    }
+};
@@ -0,0 +1,149 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Fork-join pool for data-parallel loops. A loop is cut into chunks that are dealt round-robin to
+// per-worker deques; a worker takes chunks from the back of its own deque and, once it runs dry,
+// steals from the front of the others. The calling thread works as worker 0.
+class WorkStealingPool {
+public:
+    // Runs over chunk [from, to) on the worker with the given index, 0 <= worker < workers()
+    typedef std::function<void(size_t worker, size_t from, size_t to)> ChunkBody;
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::pair<size_t, size_t>> chunks;
+    };
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable workReady_;
+    std::condition_variable workDone_;
+    unsigned long long generation_;
+    bool stop_;
+    const ChunkBody *body_;
+    std::atomic<size_t> pendingChunks_;
+
+    bool popOwn(size_t worker, std::pair<size_t, size_t> &chunk) {
+        WorkerQueue &queue = *queues_[worker];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.chunks.empty()) {
+            return false;
+        }
+        chunk = queue.chunks.back();
+        queue.chunks.pop_back();
+        return true;
+    }
+
+    bool steal(size_t worker, std::pair<size_t, size_t> &chunk) {
+        for (size_t shift = 1; shift < queues_.size(); ++shift) {
+            WorkerQueue &queue = *queues_[(worker + shift) % queues_.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (!queue.chunks.empty()) {
+                chunk = queue.chunks.front();
+                queue.chunks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Runs chunks until every deque is empty
+    void work(size_t worker) {
+        std::pair<size_t, size_t> chunk;
+        while (popOwn(worker, chunk) || steal(worker, chunk)) {
+            (*body_)(worker, chunk.first, chunk.second);
+            if (pendingChunks_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                workDone_.notify_all();
+            }
+        }
+    }
+
+    void workInBackground(size_t worker) {
+        unsigned long long seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                workReady_.wait(lock, [&]() { return stop_ || generation_ != seen; });
+                if (stop_) {
+                    return;
+                }
+                seen = generation_;
+            }
+            work(worker);
+        }
+    }
+
+public:
+    explicit WorkStealingPool(size_t workers)
+            : generation_(0), stop_(false), body_(nullptr), pendingChunks_(0) {
+        workers = std::max<size_t>(workers, 1);
+        for (size_t worker = 0; worker < workers; ++worker) {
+            queues_.emplace_back(new WorkerQueue());
+        }
+        for (size_t worker = 1; worker < workers; ++worker) {
+            threads_.emplace_back(&WorkStealingPool::workInBackground, this, worker);
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        workReady_.notify_all();
+        for (std::thread &thread : threads_) {
+            thread.join();
+        }
+    }
+
+    size_t workers() const {
+        return queues_.size();
+    }
+
+    // Calls body over [begin, end) in chunks of at most grain items and returns when all are done.
+    // Not reentrant: only one loop may run at a time.
+    void parallelFor(size_t begin, size_t end, size_t grain, const ChunkBody &body) {
+        if (begin >= end) {
+            return;
+        }
+        grain = std::max<size_t>(grain, 1);
+        size_t chunks = (end - begin + grain - 1) / grain;
+        body_ = &body;
+        pendingChunks_.store(chunks, std::memory_order_relaxed);
+        for (size_t chunk = 0; chunk < chunks; ++chunk) {
+            size_t from = begin + chunk * grain;
+            WorkerQueue &queue = *queues_[chunk % queues_.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.chunks.emplace_back(from, std::min(from + grain, end));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++generation_;
+        }
+        workReady_.notify_all();
+        work(0);
+        std::unique_lock<std::mutex> lock(mutex_);
+        workDone_.wait(lock, [this]() { return pendingChunks_.load(std::memory_order_acquire) == 0; });
+    }
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef TURN_WATCHDOG_H
+#define TURN_WATCHDOG_H
+
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include "action_manager.h"
+#include "logger.h"
+
+// Plans turns on a helper thread and stops waiting for them after a per-turn budget.
+// A late plan keeps running in the background (warming the global strategy's cached tasks)
+// while the turn is answered with a fallback acceleration.
+class TurnWatchdog {
+private:
+    ActionManager &actionManager_;
+    std::chrono::microseconds budget_;
+
+    std::mutex mutex_;
+    std::condition_variable jobReady_;
+    std::condition_variable jobDone_;
+    bool hasJob_;
+    bool busy_;
+    bool stop_;
+
+    World world_;
+    size_t ballIndex_;
+    Acceleration result_;
+
+    Acceleration lastAcceleration_;
+    bool hasLastAcceleration_;
+    Point lastTarget_;
+    bool hasLastTarget_;
+    size_t missedDeadlines_;
+
+    std::thread thread_;
+
+    void planInBackground() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            jobReady_.wait(lock, [this]() { return hasJob_ || stop_; });
+            if (stop_) {
+                return;
+            }
+            hasJob_ = false;
+            lock.unlock();
+
+            Acceleration acceleration = actionManager_.performGamerAction(world_, world_.balls[ballIndex_]);
+            Point target;
+            bool hasTarget = actionManager_.getLastTarget(target);
+
+            lock.lock();
+            result_ = acceleration;
+            lastAcceleration_ = acceleration;
+            hasLastAcceleration_ = true;
+            lastTarget_ = target;
+            hasLastTarget_ = hasTarget;
+            busy_ = false;
+            jobDone_.notify_all();
+        }
+    }
+
+    // Straight line to the last known target, else the last acceleration
+    Acceleration fallback(const Ball &ball) const {
+        if (hasLastTarget_) {
+            double accelerationX = lastTarget_.x_ - ball.position_.x_;
+            double accelerationY = lastTarget_.y_ - ball.position_.y_;
+            double length = getNorm(Point(accelerationX, accelerationY)) + 1e-4;
+            return Acceleration(accelerationX / length, accelerationY / length);
+        }
+        if (hasLastAcceleration_) {
+            return lastAcceleration_;
+        }
+        return Acceleration(0, 0);
+    }
+
+public:
+    TurnWatchdog(ActionManager &actionManager, std::chrono::microseconds budget)
+            : actionManager_(actionManager), budget_(budget), hasJob_(false), busy_(false), stop_(false),
+              ballIndex_(0), hasLastAcceleration_(false), hasLastTarget_(false), missedDeadlines_(0),
+              thread_(&TurnWatchdog::planInBackground, this) { }
+
+    ~TurnWatchdog() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        jobReady_.notify_one();
+        thread_.join();
+    }
+
+    // Takes the world by swap: the caller gets back the storage of an earlier world to parse into.
+    Acceleration performGamerAction(World &world, size_t ballIndex) {
+        Ball ball = world.balls[ballIndex];
+        unsigned long long world_id = world.world_id;
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (busy_) {
+            ++missedDeadlines_;
+            LOG_WARNING("Missed turn deadline for state %llu: still planning an earlier state", world_id);
+            return fallback(ball);
+        }
+        std::swap(world_, world);
+        ballIndex_ = ballIndex;
+        hasJob_ = true;
+        busy_ = true;
+        jobReady_.notify_one();
+
+        if (jobDone_.wait_for(lock, budget_, [this]() { return !busy_; })) {
+            return result_;
+        }
+        ++missedDeadlines_;
+        LOG_WARNING("Missed turn deadline for state %llu: budget %lld us exceeded",
+                    world_id, static_cast<long long>(budget_.count()));
+        return fallback(ball);
+    }
+
+    // Whether a plan is still running on the helper thread
+    bool busy() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return busy_;
+    }
+
+    size_t missedDeadlines() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return missedDeadlines_;
+    }
+};
+
+#endif
@@ -3,11 +3,19 @@
 //
 #include <math.h>
 #include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
 #include "game_objects.h"
 
 #ifndef SHAD_CPLUSPLUS_PROJECT_UTILS_H
 #define SHAD_CPLUSPLUS_PROJECT_UTILS_H
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEOMETRY_KERNELS_X86 1
+#endif
+
 double getNorm(const Point &vec) {
     return sqrt(vec.x_ * vec.x_ + vec.y_ * vec.y_);
 }
@@ -57,6 +65,185 @@ double getAngleToOX(const Point &current, const Point &target) {
     }
 }
 
+// Batched kernels: one point against count points given as separate x and y arrays.
+// Every path does the same operations in the same order, so all of them give identical results.
+struct GeometryKernels {
+    const char *name;
+    // out[i] = squared distance from (x, y) to (xs[i], ys[i])
+    void (*squaredDistances)(double x, double y, const double *xs, const double *ys, size_t count, double *out);
+    // out[i] = distance from (x, y) to (xs[i], ys[i])
+    void (*distances)(double x, double y, const double *xs, const double *ys, size_t count, double *out);
+    // out[i] = x * xs[i] + y * ys[i]
+    void (*products)(double x, double y, const double *xs, const double *ys, size_t count, double *out);
+    // out[i] = rotateCos(first, second, (xs[i], ys[i]))
+    void (*rotateCosines)(const Point &first, const Point &second, const double *xs, const double *ys, size_t count,
+                          double *out);
+};
+
+void squaredDistancesScalar(double x, double y, const double *xs, const double *ys, size_t count, double *out) {
+    for (size_t i = 0; i < count; ++i) {
+        double dx = xs[i] - x;
+        double dy = ys[i] - y;
+        out[i] = dx * dx + dy * dy;
+    }
+}
+
+void distancesScalar(double x, double y, const double *xs, const double *ys, size_t count, double *out) {
+    for (size_t i = 0; i < count; ++i) {
+        double dx = xs[i] - x;
+        double dy = ys[i] - y;
+        out[i] = sqrt(dx * dx + dy * dy);
+    }
+}
+
+void productsScalar(double x, double y, const double *xs, const double *ys, size_t count, double *out) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = x * xs[i] + y * ys[i];
+    }
+}
+
+void rotateCosinesScalar(const Point &first, const Point &second, const double *xs, const double *ys, size_t count,
+                         double *out) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = rotateCos(first, second, Point(xs[i], ys[i]));
+    }
+}
+
+#ifdef GEOMETRY_KERNELS_X86
+
+void squaredDistancesSse2(double x, double y, const double *xs, const double *ys, size_t count, double *out) {
+    __m128d qx = _mm_set1_pd(x), qy = _mm_set1_pd(y);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128d dx = _mm_sub_pd(_mm_loadu_pd(xs + i), qx);
+        __m128d dy = _mm_sub_pd(_mm_loadu_pd(ys + i), qy);
+        _mm_storeu_pd(out + i, _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)));
+    }
+    squaredDistancesScalar(x, y, xs + i, ys + i, count - i, out + i);
+}
+
+void distancesSse2(double x, double y, const double *xs, const double *ys, size_t count, double *out) {
+    __m128d qx = _mm_set1_pd(x), qy = _mm_set1_pd(y);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128d dx = _mm_sub_pd(_mm_loadu_pd(xs + i), qx);
+        __m128d dy = _mm_sub_pd(_mm_loadu_pd(ys + i), qy);
+        _mm_storeu_pd(out + i, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy))));
+    }
+    distancesScalar(x, y, xs + i, ys + i, count - i, out + i);
+}
+
+void productsSse2(double x, double y, const double *xs, const double *ys, size_t count, double *out) {
+    __m128d qx = _mm_set1_pd(x), qy = _mm_set1_pd(y);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        _mm_storeu_pd(out + i, _mm_add_pd(_mm_mul_pd(qx, _mm_loadu_pd(xs + i)), _mm_mul_pd(qy, _mm_loadu_pd(ys + i))));
+    }
+    productsScalar(x, y, xs + i, ys + i, count - i, out + i);
+}
+
+void rotateCosinesSse2(const Point &first, const Point &second, const double *xs, const double *ys, size_t count,
+                       double *out) {
+    double fx = second.x_ - first.x_;
+    double fy = second.y_ - first.y_;
+    __m128d firstNorm = _mm_set1_pd(sqrt(fx * fx + fy * fy + 1e-4));
+    __m128d vx = _mm_set1_pd(fx), vy = _mm_set1_pd(fy);
+    __m128d sx0 = _mm_set1_pd(second.x_), sy0 = _mm_set1_pd(second.y_), eps = _mm_set1_pd(1e-4);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128d sx = _mm_sub_pd(_mm_loadu_pd(xs + i), sx0);
+        __m128d sy = _mm_sub_pd(_mm_loadu_pd(ys + i), sy0);
+        __m128d dot = _mm_add_pd(_mm_mul_pd(vx, sx), _mm_mul_pd(vy, sy));
+        __m128d secondNorm = _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(sx, sx), _mm_mul_pd(sy, sy)), eps));
+        _mm_storeu_pd(out + i, _mm_div_pd(_mm_div_pd(dot, firstNorm), secondNorm));
+    }
+    rotateCosinesScalar(first, second, xs + i, ys + i, count - i, out + i);
+}
+
+__attribute__((target("avx2")))
+void squaredDistancesAvx2(double x, double y, const double *xs, const double *ys, size_t count, double *out) {
+    __m256d qx = _mm256_set1_pd(x), qy = _mm256_set1_pd(y);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(xs + i), qx);
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(ys + i), qy);
+        _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+    }
+    squaredDistancesScalar(x, y, xs + i, ys + i, count - i, out + i);
+}
+
+__attribute__((target("avx2")))
+void distancesAvx2(double x, double y, const double *xs, const double *ys, size_t count, double *out) {
+    __m256d qx = _mm256_set1_pd(x), qy = _mm256_set1_pd(y);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(xs + i), qx);
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(ys + i), qy);
+        _mm256_storeu_pd(out + i, _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy))));
+    }
+    distancesScalar(x, y, xs + i, ys + i, count - i, out + i);
+}
+
+__attribute__((target("avx2")))
+void productsAvx2(double x, double y, const double *xs, const double *ys, size_t count, double *out) {
+    __m256d qx = _mm256_set1_pd(x), qy = _mm256_set1_pd(y);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_mul_pd(qx, _mm256_loadu_pd(xs + i)),
+                                                _mm256_mul_pd(qy, _mm256_loadu_pd(ys + i))));
+    }
+    productsScalar(x, y, xs + i, ys + i, count - i, out + i);
+}
+
+__attribute__((target("avx2")))
+void rotateCosinesAvx2(const Point &first, const Point &second, const double *xs, const double *ys, size_t count,
+                       double *out) {
+    double fx = second.x_ - first.x_;
+    double fy = second.y_ - first.y_;
+    __m256d firstNorm = _mm256_set1_pd(sqrt(fx * fx + fy * fy + 1e-4));
+    __m256d vx = _mm256_set1_pd(fx), vy = _mm256_set1_pd(fy);
+    __m256d sx0 = _mm256_set1_pd(second.x_), sy0 = _mm256_set1_pd(second.y_), eps = _mm256_set1_pd(1e-4);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d sx = _mm256_sub_pd(_mm256_loadu_pd(xs + i), sx0);
+        __m256d sy = _mm256_sub_pd(_mm256_loadu_pd(ys + i), sy0);
+        __m256d dot = _mm256_add_pd(_mm256_mul_pd(vx, sx), _mm256_mul_pd(vy, sy));
+        __m256d secondNorm = _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(sx, sx),
+                                                                        _mm256_mul_pd(sy, sy)), eps));
+        _mm256_storeu_pd(out + i, _mm256_div_pd(_mm256_div_pd(dot, firstNorm), secondNorm));
+    }
+    rotateCosinesScalar(first, second, xs + i, ys + i, count - i, out + i);
+}
+
+#endif
+
+// The widest instruction set the CPU supports; GEOMETRY_KERNELS=scalar|sse2|avx2 in the environment overrides it
+const GeometryKernels &geometryKernels() {
+    static const GeometryKernels scalar = {"scalar", squaredDistancesScalar, distancesScalar, productsScalar,
+                                           rotateCosinesScalar};
+#ifdef GEOMETRY_KERNELS_X86
+    static const GeometryKernels sse2 = {"sse2", squaredDistancesSse2, distancesSse2, productsSse2,
+                                         rotateCosinesSse2};
+    static const GeometryKernels avx2 = {"avx2", squaredDistancesAvx2, distancesAvx2, productsAvx2,
+                                         rotateCosinesAvx2};
+    static const GeometryKernels *selected = []() {
+        const char *forced = getenv("GEOMETRY_KERNELS");
+        bool hasAvx2 = __builtin_cpu_supports("avx2");
+        bool hasSse2 = __builtin_cpu_supports("sse2");
+        if (forced && std::string(forced) == "scalar") {
+            return &scalar;
+        }
+        if (forced && std::string(forced) == "sse2" && hasSse2) {
+            return &sse2;
+        }
+        return hasAvx2 ? &avx2 : hasSse2 ? &sse2 : &scalar;
+    }();
+    return *selected;
+#else
+    return scalar;
+#endif
+}
+
 Velocity rotateAndMove(const Velocity &point, const Point &moveVector, double angle) {
     double newX = -point.v_y_ * std::sin(angle) + point.v_y_ * std::cos(angle) - moveVector.x_;
     double newY =  point.v_x_ * std::sin(angle) + point.v_y_ * std::cos(angle) - moveVector.y_;
@@ -0,0 +1,327 @@
+#ifndef WORLD_STATE_PARSER_H
+#define WORLD_STATE_PARSER_H
+
+#include <cstring>
+
+#include "protocol.h"
+
+#include "rapidjson/reader.h"
+#include "rapidjson/memorystream.h"
+
+// Streaming parser for STATE messages: fills World straight from the token stream,
+// without building a rapidjson::Document. Other message types go through MessageFromJson.
+class WorldStateHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, WorldStateHandler> {
+private:
+    enum Context {
+        TOP_LEVEL,
+        PLAYERS,
+        PLAYER,
+        COINS,
+        COIN,
+        SKIPPED
+    };
+
+    enum Field {
+        NONE,
+        TYPE,
+        STATE_ID,
+        FIELD_RADIUS,
+        PLAYER_RADIUS,
+        COIN_RADIUS,
+        TIME_DELTA,
+        VELOCITY_MAX,
+        PLAYERS_ARRAY,
+        COINS_ARRAY,
+        ID,
+        X,
+        Y,
+        V_X,
+        V_Y,
+        SCORE,
+        VALUE
+    };
+
+    World &world_;
+    Context context_;
+    Context skippedFrom_;
+    Field field_;
+    bool started_;
+    int skippedDepth_;
+    bool isState_;
+
+    size_t id_;
+    double x_, y_, vX_, vY_, score_, value_;
+
+    static bool keyIs(const char *str, rapidjson::SizeType length, const char *key) {
+        return length == std::strlen(key) && std::memcmp(str, key, length) == 0;
+    }
+
+    Field topLevelField(const char *str, rapidjson::SizeType length) const {
+        if (keyIs(str, length, "type")) return TYPE;
+        if (keyIs(str, length, "state_id")) return STATE_ID;
+        if (keyIs(str, length, "field_radius")) return FIELD_RADIUS;
+        if (keyIs(str, length, "player_radius")) return PLAYER_RADIUS;
+        if (keyIs(str, length, "coin_radius")) return COIN_RADIUS;
+        if (keyIs(str, length, "time_delta")) return TIME_DELTA;
+        if (keyIs(str, length, "velocity_max")) return VELOCITY_MAX;
+        if (keyIs(str, length, "players")) return PLAYERS_ARRAY;
+        if (keyIs(str, length, "coins")) return COINS_ARRAY;
+        return NONE;
+    }
+
+    Field objectField(const char *str, rapidjson::SizeType length) const {
+        if (keyIs(str, length, "x")) return X;
+        if (keyIs(str, length, "y")) return Y;
+        if (context_ == PLAYER) {
+            if (keyIs(str, length, "id")) return ID;
+            if (keyIs(str, length, "v_x")) return V_X;
+            if (keyIs(str, length, "v_y")) return V_Y;
+            if (keyIs(str, length, "score")) return SCORE;
+        } else if (keyIs(str, length, "value")) {
+            return VALUE;
+        }
+        return NONE;
+    }
+
+    bool number(double value) {
+        if (context_ == SKIPPED) {
+            return true;
+        }
+        switch (field_) {
+            case STATE_ID: world_.world_id = static_cast<unsigned long long>(value); break;
+            case FIELD_RADIUS: world_.field_radius = value; break;
+            case PLAYER_RADIUS: world_.ball_radius = value; break;
+            case COIN_RADIUS: world_.coin_radius = value; break;
+            case TIME_DELTA: world_.delta_time = value; break;
+            case VELOCITY_MAX: world_.max_velocity = value; break;
+            case ID: id_ = static_cast<size_t>(value); break;
+            case X: x_ = value; break;
+            case Y: y_ = value; break;
+            case V_X: vX_ = value; break;
+            case V_Y: vY_ = value; break;
+            case SCORE: score_ = value; break;
+            case VALUE: value_ = value; break;
+            default: break;
+        }
+        return true;
+    }
+
+    bool integer(uint64_t value) {
+        if (context_ != SKIPPED && field_ == STATE_ID) {
+            world_.world_id = value;
+            return true;
+        }
+        if (context_ != SKIPPED && field_ == ID) {
+            id_ = static_cast<size_t>(value);
+            return true;
+        }
+        return number(static_cast<double>(value));
+    }
+
+    // Unknown nested values are skipped as a whole
+    bool startNested() {
+        if (context_ != SKIPPED) {
+            skippedFrom_ = context_;
+            context_ = SKIPPED;
+            skippedDepth_ = 0;
+        }
+        ++skippedDepth_;
+        return true;
+    }
+
+    bool endNested() {
+        if (--skippedDepth_ == 0) {
+            context_ = skippedFrom_;
+        }
+        return true;
+    }
+
+public:
+    explicit WorldStateHandler(World &world)
+            : world_(world), context_(TOP_LEVEL), skippedFrom_(TOP_LEVEL), field_(NONE), started_(false),
+              skippedDepth_(0), isState_(false),
+              id_(0), x_(0), y_(0), vX_(0), vY_(0), score_(0), value_(0) {
+        world_.balls.clear();
+        world_.coins.clear();
+        world_.columns.clear();
+        world_.columnsSynced = true; // balls and coins are added to the columns as they are parsed
+    }
+
+    bool isState() const {
+        return isState_;
+    }
+
+    bool Default() {
+        return true;
+    }
+
+    bool Int(int value) {
+        return number(value);
+    }
+
+    bool Uint(unsigned value) {
+        return integer(value);
+    }
+
+    bool Int64(int64_t value) {
+        return number(static_cast<double>(value));
+    }
+
+    bool Uint64(uint64_t value) {
+        return integer(value);
+    }
+
+    bool Double(double value) {
+        return number(value);
+    }
+
+    bool String(const char *str, rapidjson::SizeType length, bool) {
+        if (context_ == TOP_LEVEL && field_ == TYPE) {
+            isState_ = length == mWorldStateType.size() &&
+                       std::memcmp(str, mWorldStateType.data(), length) == 0;
+            // Not a STATE message: stop early and let the caller fall back to MessageFromJson
+            return isState_;
+        }
+        return true;
+    }
+
+    bool Key(const char *str, rapidjson::SizeType length, bool) {
+        if (context_ == SKIPPED) {
+            return true;
+        }
+        field_ = context_ == TOP_LEVEL ? topLevelField(str, length) : objectField(str, length);
+        return true;
+    }
+
+    bool StartObject() {
+        if (!started_) {
+            started_ = true;
+            return true;
+        }
+        if (context_ == PLAYERS || context_ == COINS) {
+            context_ = context_ == PLAYERS ? PLAYER : COIN;
+            id_ = 0;
+            x_ = y_ = vX_ = vY_ = score_ = value_ = 0;
+            return true;
+        }
+        return startNested();
+    }
+
+    bool EndObject(rapidjson::SizeType) {
+        if (context_ == SKIPPED) {
+            return endNested();
+        }
+        if (context_ == PLAYER) {
+            world_.balls.emplace_back(id_, Point(x_, y_), Velocity(vX_, vY_), score_);
+            world_.columns.addBall(world_.balls.back());
+            context_ = PLAYERS;
+            field_ = PLAYERS_ARRAY;
+        } else if (context_ == COIN) {
+            world_.coins.emplace_back(Point(x_, y_), value_);
+            world_.columns.addCoin(world_.coins.back());
+            context_ = COINS;
+            field_ = COINS_ARRAY;
+        }
+        return true;
+    }
+
+    bool StartArray() {
+        if (context_ == TOP_LEVEL && (field_ == PLAYERS_ARRAY || field_ == COINS_ARRAY)) {
+            context_ = field_ == PLAYERS_ARRAY ? PLAYERS : COINS;
+            return true;
+        }
+        return startNested();
+    }
+
+    bool EndArray(rapidjson::SizeType) {
+        if (context_ == SKIPPED) {
+            return endNested();
+        }
+        context_ = TOP_LEVEL;
+        field_ = NONE;
+        return true;
+    }
+};
+
+// Returns true if json is a STATE message, filling world in place (ball, coin and column storage is reused).
+// On false the message is of another type or malformed, and world is left in an unspecified state.
+bool WorldStateFromJson(const char *json, size_t length, World &world) {
+    WorldStateHandler handler(world);
+    rapidjson::MemoryStream stream(json, length);
+    rapidjson::Reader reader;
+    if (reader.Parse(stream, handler).IsError()) {
+        return false;
+    }
+    return handler.isState();
+}
+
+bool WorldStateFromJson(const std::string &json, World &world) {
+    return WorldStateFromJson(json.data(), json.size(), world);
+}
+
+// Reads the top-level "type" of a message and stops, so that frames can be told apart without
+// parsing them. Messages put their type first, so this reads a few bytes of a STATE.
+class MessageTypeHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, MessageTypeHandler> {
+private:
+    int depth_;
+    bool typeNext_;
+    std::string type_;
+
+public:
+    MessageTypeHandler() : depth_(0), typeNext_(false) { }
+
+    const std::string &type() const {
+        return type_;
+    }
+
+    bool Default() {
+        typeNext_ = false;
+        return true;
+    }
+
+    bool String(const char *str, rapidjson::SizeType length, bool) {
+        if (typeNext_) {
+            type_.assign(str, length);
+            return false; // found, stop parsing
+        }
+        return true;
+    }
+
+    bool Key(const char *str, rapidjson::SizeType length, bool) {
+        typeNext_ = depth_ == 1 && length == 4 && std::memcmp(str, "type", 4) == 0;
+        return true;
+    }
+
+    bool StartObject() {
+        typeNext_ = false;
+        ++depth_;
+        return true;
+    }
+
+    bool EndObject(rapidjson::SizeType) {
+        --depth_;
+        return true;
+    }
+
+    bool StartArray() {
+        typeNext_ = false;
+        ++depth_;
+        return true;
+    }
+
+    bool EndArray(rapidjson::SizeType) {
+        --depth_;
+        return true;
+    }
+};
+
+// Whether json is a STATE message, judged by its type alone
+bool IsWorldStateJson(const char *json, size_t length) {
+    MessageTypeHandler handler;
+    rapidjson::MemoryStream stream(json, length);
+    rapidjson::Reader reader;
+    reader.Parse(stream, handler);
+    return handler.type() == mWorldStateType;
+}
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef WORLD_TRACKER_H
+#define WORLD_TRACKER_H
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "game_objects.h"
+
+typedef unsigned long long CoinId;
+
+const CoinId NO_COIN_ID = 0;
+
+// Difference between two consecutive worlds; indices refer to the newer world
+struct WorldDiff {
+    std::vector<size_t> addedCoins;
+    std::vector<CoinId> removedCoins;
+    std::vector<size_t> movedBalls; // includes balls that were not present before
+
+    bool empty() const {
+        return addedCoins.empty() && removedCoins.empty() && movedBalls.empty();
+    }
+
+    void clear() {
+        addedCoins.clear();
+        removedCoins.clear();
+        movedBalls.clear();
+    }
+};
+
+// Matches the coins of consecutive worlds to give them stable ids. Servers keep the order of the
+// coins they do not touch, so each coin is first compared with the previous world's coin at the same
+// position in the list, shifted by the offset of the last match to follow removals in the middle.
+// Only coins that fail that check are looked up in a hash of positions quantized to twice the
+// tolerance, which needs at most 2x2 keys. An update is still O(coins) comparisons, but a world
+// with few changes does almost no hashing.
+class WorldTracker {
+private:
+    struct TrackedCoin {
+        Coin coin;
+        size_t index; // index in the last world
+    };
+
+    double tolerance_;
+    double inverseCell_;
+    CoinId nextId_;
+
+    std::unordered_map<CoinId, TrackedCoin> coins_;
+    std::unordered_multimap<uint64_t, CoinId> idsByKey_; // quantized position -> coin id
+    std::vector<CoinId> ids_;                            // ids of the last world's coins, index for index
+    std::vector<Coin> previousCoins_;                    // the last world's coins
+    std::vector<char> matched_;                          // whether previousCoins_[i] was matched this update
+    std::vector<CoinId> newIds_;
+    std::vector<std::pair<CoinId, size_t>> reindexed_;   // matched coins whose index changed
+    std::vector<size_t> pending_;                        // indices of added coins
+    std::vector<Ball> balls_;
+    std::unordered_map<size_t, size_t> ballIndex_;       // ball id -> index in balls_
+    WorldDiff diff_;
+
+    static uint64_t key(long long column, long long row) {
+        return static_cast<uint64_t>(column) * 0x9E3779B97F4A7C15ULL ^ static_cast<uint64_t>(row);
+    }
+
+    long long quantize(double value) const {
+        return static_cast<long long>(std::floor(value * inverseCell_));
+    }
+
+    uint64_t keyOf(const Point &position) const {
+        return key(quantize(position.x_), quantize(position.y_));
+    }
+
+    bool same(const Coin &previous, const Coin &coin) const {
+        return previous.value_ == coin.value_ &&
+               std::fabs(previous.position_.x_ - coin.position_.x_) <= tolerance_ &&
+               std::fabs(previous.position_.y_ - coin.position_.y_) <= tolerance_;
+    }
+
+    // Whether the previous world's coin at index is unmatched and the same as coin
+    bool matchesAt(size_t index, const Coin &coin) const {
+        return index < previousCoins_.size() && !matched_[index] && same(previousCoins_[index], coin);
+    }
+
+    // Index of an unmatched coin of the previous world the same as coin, -1 if there is none.
+    // The cells are twice the tolerance wide, so the tolerance box overlaps at most 2x2 of them.
+    long long findPrevious(const Coin &coin) const {
+        long long firstColumn = quantize(coin.position_.x_ - tolerance_);
+        long long lastColumn = quantize(coin.position_.x_ + tolerance_);
+        long long firstRow = quantize(coin.position_.y_ - tolerance_);
+        long long lastRow = quantize(coin.position_.y_ + tolerance_);
+        for (long long column = firstColumn; column <= lastColumn; ++column) {
+            for (long long row = firstRow; row <= lastRow; ++row) {
+                auto range = idsByKey_.equal_range(key(column, row));
+                for (auto it = range.first; it != range.second; ++it) {
+                    size_t index = coins_.find(it->second)->second.index;
+                    if (matchesAt(index, coin)) {
+                        return static_cast<long long>(index);
+                    }
+                }
+            }
+        }
+        return -1;
+    }
+
+    void forget(CoinId id) {
+        auto coin = coins_.find(id);
+        auto range = idsByKey_.equal_range(keyOf(coin->second.coin.position_));
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == id) {
+                idsByKey_.erase(it);
+                break;
+            }
+        }
+        coins_.erase(coin);
+    }
+
+    const Ball *findBall(size_t id) const {
+        auto it = ballIndex_.find(id);
+        return it == ballIndex_.end() ? nullptr : &balls_[it->second];
+    }
+
+public:
+    explicit WorldTracker(double tolerance = 1e-2)
+            : tolerance_(tolerance), inverseCell_(0.5 / tolerance), nextId_(NO_COIN_ID + 1) { }
+
+    // Matches the world against the previous one; the first world reports every coin and ball as new
+    const WorldDiff &update(const World &world) {
+        diff_.clear();
+        reindexed_.clear();
+        pending_.clear();
+        matched_.assign(previousCoins_.size(), 0);
+        newIds_.resize(world.coins.size());
+        long long offset = 0; // previous index minus current index of the last match
+        size_t matched = 0;
+        for (size_t i = 0; i < world.coins.size(); ++i) {
+            const Coin &coin = world.coins[i];
+            long long previous = static_cast<long long>(i) + offset;
+            if (previous < 0 || !matchesAt(static_cast<size_t>(previous), coin)) {
+                previous = matchesAt(i, coin) ? static_cast<long long>(i) : findPrevious(coin);
+            }
+            if (previous < 0) {
+                pending_.push_back(i);
+                continue;
+            }
+            size_t index = static_cast<size_t>(previous);
+            offset = previous - static_cast<long long>(i);
+            matched_[index] = 1;
+            ++matched;
+            newIds_[i] = ids_[index];
+            if (index != i) {
+                reindexed_.emplace_back(ids_[index], i);
+            }
+        }
+        // Indices are updated only now, as findPrevious reads the previous ones
+        if (matched < ids_.size()) {
+            for (size_t index = 0; index < ids_.size(); ++index) {
+                if (!matched_[index]) {
+                    diff_.removedCoins.push_back(ids_[index]);
+                    forget(ids_[index]);
+                }
+            }
+        }
+        for (const std::pair<CoinId, size_t> &coin : reindexed_) {
+            coins_.find(coin.first)->second.index = coin.second;
+        }
+        for (size_t i : pending_) {
+            CoinId id = nextId_++;
+            TrackedCoin added = {world.coins[i], i};
+            coins_.emplace(id, added);
+            idsByKey_.emplace(keyOf(world.coins[i].position_), id);
+            newIds_[i] = id;
+            diff_.addedCoins.push_back(i);
+        }
+        ids_.swap(newIds_);
+        previousCoins_ = world.coins;
+
+        for (size_t i = 0; i < world.balls.size(); ++i) {
+            const Ball &ball = world.balls[i];
+            const Ball *previous = findBall(ball.id_);
+            if (!previous || previous->position_.x_ != ball.position_.x_ ||
+                previous->position_.y_ != ball.position_.y_) {
+                diff_.movedBalls.push_back(i);
+            }
+        }
+        balls_ = world.balls;
+        ballIndex_.clear();
+        for (size_t i = 0; i < balls_.size(); ++i) {
+            ballIndex_[balls_[i].id_] = i;
+        }
+        return diff_;
+    }
+
+    const WorldDiff &lastDiff() const {
+        return diff_;
+    }
+
+    // Id of the coin with the given index in the last world
+    CoinId coinId(size_t index) const {
+        return ids_[index];
+    }
+
+    // Index of the coin in the last world, -1 if it is gone
+    int coinIndex(CoinId id) const {
+        auto it = coins_.find(id);
+        return it == coins_.end() ? -1 : static_cast<int>(it->second.index);
+    }
+
+    bool hasCoin(CoinId id) const {
+        return coins_.count(id) > 0;
+    }
+};
+
+#endif